@@ -43,3 +43,9 @@ regression_random_baremetal:
 regression_dhrystone:
 	cd ../..
 	sbt "testOnly vexriscv.DhrystoneBench"
+
+regression_benchmark:
+	cd ../..
+	sbt "runMain vexriscv.demo.GenFull"
+	cd src/test/cpp/regression
+	make clean run BENCH=yes ISA_TEST=no DHRYSTONE=yes COREMARK=yes FREERTOS=yes REDO=1
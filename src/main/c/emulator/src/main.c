@@ -238,7 +238,7 @@ void trap(){
 					switch(csrAddress){
 					case RDCYCLE :
 					case RDINSTRET:
-					case RDTIME  : old = rdtime(); break;
+					case RDTIME  : old = rdtime(); break; //Only trap there when the CPU has no utime input
 					case RDCYCLEH :
 					case RDINSTRETH:
 					case RDTIMEH : old = rdtimeh(); break;
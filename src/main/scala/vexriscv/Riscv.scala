@@ -159,6 +159,8 @@ object Riscv{
 
     def UCYCLE    = 0xC00 // UR Machine ucycle counter.
     def UCYCLEH   = 0xC80
+    def UTIME     = 0xC01 // rdtime
+    def UTIMEH    = 0xC81
     def UINSTRET  = 0xC02 // UR Machine instructions-retired counter.
     def UINSTRETH = 0xC82 // UR Upper 32 bits of minstret, RV32I only.
   }
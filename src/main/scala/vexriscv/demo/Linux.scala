@@ -134,7 +134,7 @@ make clean run  IBUS=CACHED DBUS=CACHED DEBUG_PLUGIN=STD DHRYSTONE=yes SUPERVISO
 
 
 object LinuxGen {
-  def configFull(litex : Boolean, withMmu : Boolean) = {
+  def configFull(litex : Boolean, withMmu : Boolean, withUtime : Boolean = false) = {
     val config = VexRiscvConfig(
       plugins = List(
         //Uncomment the whole IBusSimplePlugin and comment IBusCachedPlugin if you want uncached iBus config
@@ -248,7 +248,7 @@ object LinuxGen {
           divUnrollFactor = 1
         ),
         //          new DivPlugin,
-        new CsrPlugin(CsrPluginConfig.linuxMinimal(0x80000020l).copy(ebreakGen = false)),
+        new CsrPlugin(CsrPluginConfig.linuxMinimal(0x80000020l).copy(ebreakGen = false, utimeAccess = if(withUtime) CsrAccess.READ_ONLY else CsrAccess.NONE)), //utime has to be driven by the toplevel
         //          new CsrPlugin(//CsrPluginConfig.all2(0x80000020l).copy(ebreakGen = true)/*
         //             CsrPluginConfig(
         //            catchIllegalAccess = false,
@@ -315,7 +315,8 @@ object LinuxGen {
 
       val toplevel = new VexRiscv(configFull(
         litex = !args.contains("-r"),
-        withMmu = true
+        withMmu = true,
+        withUtime = args.contains("-r") //The regression testbench drives utime from its mtime
       ))
 //      val toplevel = new VexRiscv(configLight)
 //      val toplevel = new VexRiscv(configTest)
@@ -50,6 +50,7 @@ case class CsrPluginConfig(
                             minstretAccess      : CsrAccess,
                             ucycleAccess        : CsrAccess,
                             uinstretAccess      : CsrAccess = CsrAccess.NONE,
+                            utimeAccess         : CsrAccess = CsrAccess.NONE, //Read the external utime input (mtime)
                             wfiGenAsWait        : Boolean,
                             ecallGen            : Boolean,
                             xtvecModeGen        : Boolean = false,
@@ -75,6 +76,7 @@ case class CsrPluginConfig(
                             wfiOutput           : Boolean = false
                           ){
   assert(!ucycleAccess.canWrite)
+  assert(!utimeAccess.canWrite)
   def privilegeGen = userGen || supervisorGen
   def noException = this.copy(ecallGen = false, ebreakGen = false, catchIllegalAccess = false)
   def noExceptionButEcall = this.copy(ecallGen = true, ebreakGen = false, catchIllegalAccess = false)
@@ -372,6 +374,7 @@ class CsrPlugin(val config: CsrPluginConfig) extends Plugin[VexRiscv] with Excep
   var jumpInterface : Flow[UInt] = null
   var timerInterrupt, externalInterrupt, softwareInterrupt : Bool = null
   var externalInterruptS : Bool = null
+  var utime : UInt = null
   var forceMachineWire : Bool = null
   var privilege : UInt = null
   var selfException : Flow[ExceptionCause] = null
@@ -491,6 +494,7 @@ class CsrPlugin(val config: CsrPluginConfig) extends Plugin[VexRiscv] with Excep
 //      timerInterruptS    = in Bool() setName("timerInterruptS")
       externalInterruptS = in Bool() setName("externalInterruptS")
     }
+    if(utimeAccess != CsrAccess.NONE) utime = in UInt(64 bits) setName("utime")
     contextSwitching = Bool().setName("contextSwitching")
 
     privilege = UInt(2 bits).setName("CsrPlugin_privilege")
@@ -620,6 +624,10 @@ class CsrPlugin(val config: CsrPluginConfig) extends Plugin[VexRiscv] with Excep
       ucycleAccess(CSR.UCYCLEH, mcycle(63 downto 32))
       uinstretAccess(CSR.UINSTRET, minstret(31 downto 0))
       uinstretAccess(CSR.UINSTRETH, minstret(63 downto 32))
+      if(utimeAccess != CsrAccess.NONE) {
+        utimeAccess(CSR.UTIME, utime(31 downto 0))
+        utimeAccess(CSR.UTIMEH, utime(63 downto 32))
+      }
 
       pipeline(MPP) := mstatus.MPP
     }
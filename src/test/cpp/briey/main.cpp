@@ -19,6 +19,7 @@
 #include <iomanip>
 #include <time.h>
 #include <unistd.h>
+#include <math.h>
 
 #include "VBriey_VexRiscv.h"
 
@@ -47,6 +48,17 @@ public:
 	}
 };
 
+//JEDEC timings checked by SDRAM_CHECK, in ns, or in cycles for the c prefixed ones.
+//The defaults are the IS42x320D grade 7 ones used by Briey.
+class SdramTimings{
+public:
+	double tRCD = 15, tRP = 15, tRAS = 37, tRC = 60, tRFC = 60, tWR = 10;
+	double tREF = 64e6;
+	uint32_t cMRD = 2;
+	uint32_t refreshRows = 8192;
+	uint32_t refreshPostpone = 8;
+};
+
 class SdramIo{
 public:
 	CData *BA;
@@ -70,22 +82,55 @@ public:
 
 	uint32_t CAS;
 	uint32_t burstLength;
-
+	uint64_t cycle = 0;
+
+	#ifdef SDRAM_CHECK
+	//Timings in cycles, with the last cycle of each command kind
+	uint32_t cRCD, cRP, cRAS, cRC, cRFC, cWR, cREFI;
+	SdramTimings *timings;
+	uint64_t lastModeSet = 0, lastRefresh = 0;
+	bool refreshed = false;
+	uint64_t violations = 0;
+	void violation(const char *what, uint32_t bankId){
+		if(violations++ < 100) printf("SDRAM : %s violation on bank %d at cycle %ld\n", what, bankId, cycle);
+	}
+	#endif
+
+	#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+	enum Access {NONE, READ, WRITE};
+	uint64_t lastRead = 0, lastWrite = 0;
+	Access lastAccess = NONE;
+	#endif
+	#ifdef SDRAM_STATS
+	uint64_t firstCycle = 0, turnarounds = 0, dataCycles = 0;
+	#endif
+
+	//Rows are allocated on their first write, reads of untouched rows return 0
 	class Bank{
 	public:
-		uint8_t *data;
+		uint8_t **rows;
 		SdramConfig *config;
+		uint32_t rowBytes;
 
 		bool opened;
 		uint32_t openedRow;
+		#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+		uint64_t lastActivate = 0, lastPrecharge = 0, lastWrite = 0;
+		bool used = false, accessedSinceActivate = false;
+		#endif
+		#ifdef SDRAM_STATS
+		uint64_t activates = 0, precharges = 0, reads = 0, writes = 0, rowHits = 0;
+		#endif
 		void init(SdramConfig *config){
 			this->config = config;
-			data = new uint8_t[config->rowSize * config->colSize * config->byteCount];
+			rowBytes = config->colSize * config->byteCount;
+			rows = new uint8_t*[config->rowSize]();
 			opened = false;
 		}
 
-		virtual ~Bank(){
-			delete data;
+		~Bank(){
+			for(uint32_t row = 0;row < config->rowSize;row++) delete[] rows[row];
+			delete[] rows;
 		}
 
 		void activate(uint32_t row){
@@ -99,39 +144,140 @@ public:
 			opened = false;
 		}
 
-		void write(uint32_t column, CData byteId, CData data){
+		//One word of byteCount bytes, the bytes with their DQM bit set are kept
+		void write(uint32_t column, uint32_t dqm, uint32_t data){
 			if(!opened)
 				cout << "SDRAM : write in closed bank" << endl;
-			uint32_t addr = byteId + (column + openedRow * config->colSize) * config->byteCount;
-			//printf("SDRAM : Write A=%08x D=%02x\n",addr,data);
-			this->data[addr] = data;
-
+			uint8_t *&row = rows[openedRow];
+			if(!row) row = new uint8_t[rowBytes]();
+			uint8_t *ptr = row + column * config->byteCount;
+			if(dqm == 0){
+				memcpy(ptr, &data, config->byteCount);
+			} else {
+				for(uint32_t byteId = 0;byteId < config->byteCount;byteId++){
+					if(((dqm >> byteId) & 1) == 0) ptr[byteId] = data >> byteId*8;
+				}
+			}
 		}
 
-		CData read(uint32_t column, CData byteId){
+		uint32_t read(uint32_t column){
 			if(!opened)
 				cout << "SDRAM : write in closed bank" << endl;
-			uint32_t addr = byteId + (column + openedRow * config->colSize) * config->byteCount;
-			//printf("SDRAM : Read A=%08x D=%02x\n",addr,data[addr]);
-			return data[addr];
+			uint32_t data = 0;
+			uint8_t *row = rows[openedRow];
+			if(row) memcpy(&data, row + column * config->byteCount, config->byteCount);
+			return data;
 		}
 	};
 
 	Bank* banks;
 
-	CData * readShifter;
+	//Read data of each cycle, DQ_read gives back the one of CAS-1 cycles before
+	#define SDRAM_READ_PIPELINE 4
+	uint32_t readData = 0;
+	uint32_t readPipeline[SDRAM_READ_PIPELINE] = {0};
+	uint32_t readPtr = 0;
 
 	Sdram(SdramConfig *config,SdramIo* io){
 		this->config = config;
 		this->io = io;
 		banks = new Bank[config->bankCount];
 		for(uint32_t bankId = 0;bankId < config->bankCount;bankId++) banks[bankId].init(config);
-		readShifter = new CData[config->byteCount*3];
 	}
 
+	#ifdef SDRAM_CHECK
+	void setTimings(SdramTimings *timings, double clockPeriodNs){
+		this->timings = timings;
+		auto cycles = [clockPeriodNs](double ns) { return (uint32_t)ceil(ns/clockPeriodNs - 1e-6); };
+		cRCD = cycles(timings->tRCD);
+		cRP = cycles(timings->tRP);
+		cRAS = cycles(timings->tRAS);
+		cRC = cycles(timings->tRC);
+		cRFC = cycles(timings->tRFC);
+		cWR = cycles(timings->tWR);
+		cREFI = timings->tREF/timings->refreshRows/clockPeriodNs;
+	}
+	#endif
+
+	#ifdef SDRAM_STATS
+	void printStats(){
+		uint64_t cycles = max<uint64_t>(1, cycle - firstCycle);
+		for(uint32_t bankId = 0;bankId < config->bankCount;bankId++){
+			Bank &bank = banks[bankId];
+			uint64_t accesses = bank.reads + bank.writes;
+			printf("SDRAM bank %d : activates=%ld precharges=%ld reads=%ld writes=%ld rowHitRate=%.1f%%\n",
+				bankId, bank.activates, bank.precharges, bank.reads, bank.writes, 100.0*bank.rowHits/max<uint64_t>(1, accesses));
+		}
+		printf("SDRAM : readWriteTurnarounds=%ld bandwidthUtilization=%.2f%%", turnarounds, 100.0*dataCycles/cycles);
+		#ifdef SDRAM_CHECK
+		printf(" timingViolations=%ld", violations);
+		#endif
+		printf("\n");
+	}
+	#endif
+
+	#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+	void onAccess(uint32_t bankId, Access access){
+		Bank &bank = banks[bankId];
+		#ifdef SDRAM_CHECK
+		if(bank.opened && cycle - bank.lastActivate < cRCD) violation("tRCD", bankId);
+		if(access == WRITE && lastAccess == READ && cycle - lastRead <= CAS) violation("read to write DQ turnaround", bankId);
+		#endif
+		#ifdef SDRAM_STATS
+		if(access == READ) bank.reads++; else bank.writes++;
+		if(bank.accessedSinceActivate) bank.rowHits++;
+		if(lastAccess != NONE && lastAccess != access) turnarounds++;
+		dataCycles++;
+		#endif
+		bank.accessedSinceActivate = true;
+		if(access == READ) lastRead = cycle; else lastWrite = bank.lastWrite = cycle;
+		lastAccess = access;
+	}
+
+	void onActivate(uint32_t bankId){
+		Bank &bank = banks[bankId];
+		#ifdef SDRAM_CHECK
+		if(bank.used && cycle - bank.lastPrecharge < cRP) violation("tRP", bankId);
+		if(bank.used && cycle - bank.lastActivate < cRC) violation("tRC", bankId);
+		if(refreshed && cycle - lastRefresh < cRFC) violation("tRFC", bankId);
+		if(cycle - lastModeSet < timings->cMRD) violation("tMRD", bankId);
+		#endif
+		#ifdef SDRAM_STATS
+		bank.activates++;
+		#endif
+		bank.used = true;
+		bank.accessedSinceActivate = false;
+		bank.lastActivate = cycle;
+	}
+
+	void onPrecharge(uint32_t bankId){
+		Bank &bank = banks[bankId];
+		if(!bank.opened) return;
+		#ifdef SDRAM_CHECK
+		if(cycle - bank.lastActivate < cRAS) violation("tRAS", bankId);
+		if(bank.lastWrite > bank.lastActivate && cycle - bank.lastWrite < cWR) violation("tWR", bankId);
+		#endif
+		#ifdef SDRAM_STATS
+		bank.precharges++;
+		#endif
+		bank.lastPrecharge = cycle;
+	}
+
+	void onRefresh(){
+		#ifdef SDRAM_CHECK
+		for(uint32_t bankId = 0;bankId < config->bankCount;bankId++){
+			if(banks[bankId].opened) violation("refresh of an opened bank", bankId);
+		}
+		if(refreshed && cycle - lastRefresh > (timings->refreshPostpone+1)*cREFI) violation("refresh interval", 0);
+		if(refreshed && cycle - lastRefresh < cRFC) violation("tRFC", 0);
+		refreshed = true;
+		lastRefresh = cycle;
+		#endif
+	}
+	#endif
+
 	virtual ~Sdram(){
-		delete banks;
-		delete readShifter;
+		delete[] banks;
 	}
 
 
@@ -139,19 +285,16 @@ public:
 
 
 	virtual void postCycle(){
-		if(CAS >= 2 && CAS <=3){
-			for(uint32_t byteId = 0;byteId != config->byteCount;byteId++){
-				io->DQ_read[byteId] = readShifter[byteId + (CAS-1)*config->byteCount];
-			}
-			for(uint32_t latency = CAS-1;latency != 0;latency--){  //missing CKE
-				for(uint32_t byteId = 0;byteId != config->byteCount;byteId++){
-					readShifter[byteId+latency*config->byteCount] = readShifter[byteId+(latency-1)*config->byteCount];
-				}
-			}
+		if(CAS >= 2 && CAS <=3){  //missing CKE
+			readPtr = (readPtr + 1) & (SDRAM_READ_PIPELINE-1);
+			readPipeline[readPtr] = readData;
+			uint32_t data = readPipeline[(readPtr - (CAS-1)) & (SDRAM_READ_PIPELINE-1)];
+			memcpy(io->DQ_read, &data, config->byteCount);
 		}
 	}
 
 	virtual void preCycle(){
+		cycle++;
 		if(!*io->CSn && ckeLast){
 			uint32_t code = ((*io->RASn) << 2) | ((*io->CASn) << 1) | ((*io->WEn) << 0);
 			switch(code){
@@ -162,31 +305,49 @@ public:
 					if((*io->ADDR & 0x388) != 0)
 						cout << "SDRAM : ???" << endl;
 					printf("SDRAM : MODE REGISTER DEFINITION CAS=%d burstLength=%d\n",CAS,burstLength);
+					#ifdef SDRAM_CHECK
+					lastModeSet = cycle;
+					#endif
+					#ifdef SDRAM_STATS
+					firstCycle = cycle;
+					#endif
 				}
 				break;
 			case 2: //Bank precharge
 				if((*io->ADDR & 0x400) != 0){ //all
-					for(uint32_t bankId = 0;bankId < config->bankCount;bankId++)
+					for(uint32_t bankId = 0;bankId < config->bankCount;bankId++){
+						#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+						onPrecharge(bankId);
+						#endif
 						banks[bankId].precharge();
+					}
 				} else { //single
+					#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+					onPrecharge(*io->BA);
+					#endif
 					banks[*io->BA].precharge();
 				}
 				break;
 			case 3: //Bank activate
+				#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+				onActivate(*io->BA);
+				#endif
 				banks[*io->BA].activate(*io->ADDR & 0x7FF);
 				break;
-			case 4: //Write
+			case 4: { //Write
 				if((*io->ADDR & 0x400) != 0)
 					cout << "SDRAM : Write autoprecharge not supported" << endl;
 
 				if(*io->DQ_writeEnable == 0)
 					cout << "SDRAM : Write Wrong DQ direction" << endl;
 
-				for(uint32_t byteId = 0;byteId < config->byteCount;byteId++){
-					if(((*io->DQM >> byteId) & 1) == 0)
-						banks[*io->BA].write(*io->ADDR, byteId ,io->DQ_write[byteId]);
-				}
-				break;
+				#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+				onAccess(*io->BA, WRITE);
+				#endif
+				uint32_t data = 0;
+				memcpy(&data, io->DQ_write, config->byteCount);
+				banks[*io->BA].write(*io->ADDR & (config->colSize-1), *io->DQM, data);
+			} break;
 
 			case 5: //Read
 				if((*io->ADDR & 0x400) != 0)
@@ -198,11 +359,15 @@ public:
 				//if(*io->DQM !=  config->byteCount-1)
 					//cout << "SDRAM : READ wrong DQM" << endl;
 
-				for(uint32_t byteId = 0;byteId < config->byteCount;byteId++){
-					readShifter[byteId] = banks[*io->BA].read(*io->ADDR, byteId);
-				}
+				#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+				onAccess(*io->BA, READ);
+				#endif
+				readData = banks[*io->BA].read(*io->ADDR & (config->colSize-1));
 				break;
-			case 1: // Self refresh
+			case 1: // Auto refresh (self refresh when CKE goes low)
+				#if defined(SDRAM_CHECK) || defined(SDRAM_STATS)
+				onRefresh();
+				#endif
 				break;
 			case 7: // NOP
 				break;
@@ -216,11 +381,137 @@ public:
 };
 
 
+#ifdef TRACE_COMMIT
+#include <zlib.h>
+#include <thread>
+#include "../common/spsc_ring.h"
+
+//Binary commit trace, read back as text by src/test/python/tool/commitTrace.py. After the "VXCT" magic and a version
+//byte, each record is :
+//- flags : COMMIT (an instruction commits), PC_SEQ (pc is the previous one + 4), INSTR_CACHED (same instruction as the
+//  last time this pc was traced), REG (a register is written)
+//- cycle delta from the previous record, as varint
+//- pc delta as zigzag varint, when not PC_SEQ
+//- instruction as u32, when COMMIT and not INSTR_CACHED
+//- rd, then value delta from the previous value of rd as zigzag varint, when REG
+//The simulation only encodes records in chunks, a compressor thread gzip them into commitTrace.gz
+#define COMMIT_TRACE_COMMIT 0x01
+#define COMMIT_TRACE_PC_SEQ 0x02
+#define COMMIT_TRACE_INSTR_CACHED 0x04
+#define COMMIT_TRACE_REG 0x08
+#define COMMIT_TRACE_CHUNK 0x10000
+#define COMMIT_TRACE_CHUNKS 16
+#define COMMIT_TRACE_CACHE 1024
+
+class CommitTrace{
+public:
+	struct Chunk{
+		uint8_t data[COMMIT_TRACE_CHUNK];
+		uint32_t size = 0;
+	};
+	SpscRing<Chunk*, COMMIT_TRACE_CHUNKS> filled, spare;
+	Chunk *chunk;
+	std::atomic<bool> stop{false};
+	std::thread *compressor;
+	gzFile file;
+
+	uint64_t lastCycle = 0;
+	uint32_t lastPc = 0;
+	uint32_t regs[32] = {0};
+	uint32_t instructions[COMMIT_TRACE_CACHE] = {0};
+
+	CommitTrace(const char *path){
+		file = gzopen(path, "wb1");
+		if(!file){
+			cout << "TRACE_COMMIT can't open " << path << endl;
+			exit(1);
+		}
+		for(int i = 0;i < COMMIT_TRACE_CHUNKS-1;i++) spare.push(new Chunk());
+		chunk = new Chunk();
+		const uint8_t header[] = {'V','X','C','T',1};
+		memcpy(chunk->data, header, sizeof(header));
+		chunk->size = sizeof(header);
+		compressor = new std::thread([this](){ compress(); });
+	}
+
+	~CommitTrace(){
+		filled.push(chunk);
+		stop = true;
+		compressor->join();
+		delete compressor;
+		gzclose(file);
+		//The compressor gave all the chunks back
+		Chunk *c;
+		while(spare.pop(&c)) delete c;
+	}
+
+	void varint(uint32_t value){
+		while(value >= 0x80){
+			chunk->data[chunk->size++] = value | 0x80;
+			value >>= 7;
+		}
+		chunk->data[chunk->size++] = value;
+	}
+
+	void zigzag(int32_t value){
+		varint((value << 1) ^ (value >> 31));
+	}
+
+	//Largest record is 1 + 5 + 5 + 4 + 1 + 5 bytes
+	void add(uint64_t cycle, uint32_t pc, bool commit, uint32_t instruction, bool reg, uint32_t rd, uint32_t value){
+		if(chunk->size > COMMIT_TRACE_CHUNK - 32){
+			filled.push(chunk);
+			while(!spare.pop(&chunk)) usleep(100);
+			chunk->size = 0;
+		}
+		uint32_t &cached = instructions[(pc >> 2) & (COMMIT_TRACE_CACHE-1)];
+		uint8_t flags = 0;
+		if(commit) flags |= COMMIT_TRACE_COMMIT;
+		if(pc == lastPc + 4) flags |= COMMIT_TRACE_PC_SEQ;
+		if(commit && cached == instruction) flags |= COMMIT_TRACE_INSTR_CACHED;
+		if(reg) flags |= COMMIT_TRACE_REG;
+		chunk->data[chunk->size++] = flags;
+		varint(cycle - lastCycle);
+		if(!(flags & COMMIT_TRACE_PC_SEQ)) zigzag(pc - lastPc);
+		if(commit && !(flags & COMMIT_TRACE_INSTR_CACHED)){
+			memcpy(chunk->data + chunk->size, &instruction, 4);
+			chunk->size += 4;
+			cached = instruction;
+		}
+		if(reg){
+			chunk->data[chunk->size++] = rd;
+			zigzag(value - regs[rd]);
+			regs[rd] = value;
+		}
+		lastCycle = cycle;
+		lastPc = pc;
+	}
+
+	void compress(){
+		while(1){
+			//Load stop before draining, so the last chunk pushed before it is always written
+			bool stopping = stop;
+			Chunk *c;
+			while(filled.pop(&c)){
+				gzwrite(file, c->data, c->size);
+				spare.push(c);
+			}
+			if(stopping) break;
+			usleep(1000);
+		}
+	}
+};
+#endif
+
 class VexRiscvTracer : public SimElement{
 public:
 	VBriey_VexRiscv *cpu;
 	ofstream instructionTraces;
 	ofstream regTraces;
+	#ifdef TRACE_COMMIT
+	CommitTrace *commitTrace;
+	uint64_t cycle = 0;
+	#endif
 
 	VexRiscvTracer(VBriey_VexRiscv *cpu){
 		this->cpu = cpu;
@@ -229,6 +520,15 @@ public:
 #endif
 #ifdef TRACE_REG
 	regTraces.open ("regTraces.log");
+#endif
+#ifdef TRACE_COMMIT
+	commitTrace = new CommitTrace("commitTrace.gz");
+#endif
+	}
+
+	virtual ~VexRiscvTracer(){
+#ifdef TRACE_COMMIT
+		delete commitTrace;
 #endif
 	}
 
@@ -245,6 +545,15 @@ public:
 			regTraces << " PC " << hex << setw(8) <<  cpu->writeBack_PC << " : reg[" << dec << setw(2) << (uint32_t)cpu->writeBack_RegFilePlugin_regFileWrite_payload_address << "] = " << hex << setw(8) << cpu->writeBack_RegFilePlugin_regFileWrite_payload_data << endl;
 		}
 
+#endif
+#ifdef TRACE_COMMIT
+		cycle++;
+		bool commit = cpu->writeBack_arbitration_isFiring;
+		bool reg = cpu->writeBack_RegFilePlugin_regFileWrite_valid == 1 && cpu->writeBack_RegFilePlugin_regFileWrite_payload_address != 0;
+		if(commit || reg){
+			commitTrace->add(cycle, cpu->writeBack_PC, commit, cpu->writeBack_INSTRUCTION,
+				reg, cpu->writeBack_RegFilePlugin_regFileWrite_payload_address, cpu->writeBack_RegFilePlugin_regFileWrite_payload_data);
+		}
 #endif
 	}
 };
@@ -252,60 +561,55 @@ public:
 
 
 
+#ifndef VGA_HEADLESS
 #include <SDL2/SDL.h>
+#endif
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
-
-
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//The simulation draws a frame in pixels while a presenter thread shows, captures and clears the previous one. On vsync,
+//refresh swaps both buffers, it only waits if the presenter is still busy with the previous frame.
+//VGA_HEADLESS : no SDL window, the checksum of each frame is printed
+//VGA_CAPTURE : each frame is also written as vga_XXXXX.ppm
 class Display : public SimElement{
 public:
 	int width, height;
-	uint32_t *pixels;
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_Texture * texture;
-    uint32_t x,y;
-    uint32_t refreshCounter = 0;
-
-    Display(int width, int height){
+	uint32_t *pixels, *presented;
+	uint32_t x,y;
+	uint32_t frameCounter = 0;
+
+	mutex presentMutex;
+	condition_variable presentCond;
+	bool presentPending = false, presenterStop = false;
+	thread *presenter;
+
+	Display(int width, int height){
 		this->width = width;
 		this->height = height;
 		x = y = 0;
-		init();
+		pixels = new uint32_t[width * height]();
+		presented = new uint32_t[width * height]();
+		presenter = new thread([this](){ present(); });
 	}
 
 	virtual ~Display(){
-	    delete[] pixels;
-	    SDL_DestroyTexture(texture);
-	    SDL_DestroyRenderer(renderer);
-	    SDL_DestroyWindow(window);
-	    SDL_Quit();
-	}
-
-	void init(){
-
-        /* Initialize SDL. */
-        if (SDL_Init(SDL_INIT_VIDEO) < 0)
-                return;
-
-        /* Create the window where we will draw. */
-        window = SDL_CreateWindow("VGA",
-                        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                        width, height,
-                        SDL_WINDOW_SHOWN);
-
-        /* We must call SDL_CreateRenderer in order for draw calls to affect this window. */
-        renderer = SDL_CreateRenderer(window, -1, 0);
-
-        texture = SDL_CreateTexture(renderer,
-            SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, width, height);
-        pixels = new Uint32[width * height];
-        memset(pixels, 0, width * height * sizeof(Uint32));
+		{
+			unique_lock<mutex> lock(presentMutex);
+			presenterStop = true;
+			presentCond.notify_all();
+		}
+		presenter->join();
+		delete presenter;
+		delete[] pixels;
+		delete[] presented;
 	}
 
 	void set(uint32_t color){
-		pixels[x + y*width] = color;
+		if(x < width && y < height) pixels[x + y*width] = color;
 	}
 
 	void incX(){
@@ -319,12 +623,99 @@ public:
 	}
 
 	void refresh(){
-		//cout << "Display refresh " << refreshCounter++ << endl;
-		SDL_UpdateTexture(texture, NULL, pixels, 640 * sizeof(Uint32));
-		SDL_RenderClear(renderer);
-		SDL_RenderCopy(renderer, texture, NULL, NULL);
-		SDL_RenderPresent(renderer);
-        memset(pixels, 0, width * height * sizeof(Uint32));
+		unique_lock<mutex> lock(presentMutex);
+		presentCond.wait(lock, [this](){ return !presentPending; });
+		swap(pixels, presented);
+		presentPending = true;
+		presentCond.notify_all();
+	}
+
+	void present(){
+		bool headless = true;
+		#ifndef VGA_HEADLESS
+		//All the SDL calls are done from this thread. Without display, fall back on the headless checksums, as the
+		//simulation still waits on each frame to be presented
+		SDL_Window* window = NULL;
+		SDL_Renderer* renderer = NULL;
+		SDL_Texture * texture = NULL;
+		if (SDL_Init(SDL_INIT_VIDEO) < 0){
+			printf("VGA SDL_Init failed (%s), running headless\n", SDL_GetError());
+		} else {
+			window = SDL_CreateWindow("VGA",
+							SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+							width, height,
+							SDL_WINDOW_SHOWN);
+			renderer = SDL_CreateRenderer(window, -1, 0);
+			texture = SDL_CreateTexture(renderer,
+				SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, width, height);
+			headless = false;
+		}
+		#endif
+
+		while(1){
+			{
+				unique_lock<mutex> lock(presentMutex);
+				presentCond.wait(lock, [this](){ return presentPending || presenterStop; });
+				if(!presentPending) break;
+			}
+
+			#ifdef VGA_CAPTURE
+			bool checksummed = true;
+			#else
+			bool checksummed = headless;
+			#endif
+			if(checksummed){
+				uint64_t checksum = 0xcbf29ce484222325;
+				for(int i = 0;i < width * height;i++) checksum = (checksum ^ presented[i]) * 0x100000001b3;
+				printf("VGA frame %d checksum %016lx\n", frameCounter, checksum);
+			}
+			#ifdef VGA_CAPTURE
+			capture();
+			#endif
+			#ifndef VGA_HEADLESS
+			if(!headless){
+				SDL_UpdateTexture(texture, NULL, presented, width * sizeof(Uint32));
+				SDL_RenderClear(renderer);
+				SDL_RenderCopy(renderer, texture, NULL, NULL);
+				SDL_RenderPresent(renderer);
+			}
+			#endif
+			memset(presented, 0, width * height * sizeof(uint32_t));
+			frameCounter++;
+
+			unique_lock<mutex> lock(presentMutex);
+			presentPending = false;
+			presentCond.notify_all();
+		}
+
+		#ifndef VGA_HEADLESS
+		if(!headless){
+			SDL_DestroyTexture(texture);
+			SDL_DestroyRenderer(renderer);
+			SDL_DestroyWindow(window);
+			SDL_Quit();
+		}
+		#endif
+	}
+
+	void capture(){
+		char name[32];
+		sprintf(name, "vga_%05d.ppm", frameCounter);
+		FILE *file = fopen(name, "wb");
+		if(!file) return;
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		uint8_t *line = new uint8_t[width*3];
+		for(int y = 0;y < height;y++){
+			for(int x = 0;x < width;x++){
+				uint32_t color = presented[x + y*width];
+				line[x*3+0] = color >> 16;
+				line[x*3+1] = color >> 8;
+				line[x*3+2] = color;
+			}
+			fwrite(line, 1, width*3, file);
+		}
+		delete[] line;
+		fclose(file);
 	}
 
 	virtual void postCycle(){
@@ -372,6 +763,9 @@ public:
 
 class BrieyWorkspace : public Workspace<VBriey>{
 public:
+	Sdram *sdram;
+	VexRiscvTracer *tracer;
+
 	BrieyWorkspace() : Workspace("Briey"){
 		ClockDomain *axiClk = new ClockDomain(&top->io_axiClk,NULL,20000,100000);
 		ClockDomain *vgaClk = new ClockDomain(&top->io_vgaClk,NULL,40000,100000);
@@ -402,7 +796,10 @@ public:
 		sdramIo->DQ_read         = (CData*)&top->io_sdram_DQ_read        ;
 		sdramIo->DQ_write        = (CData*)&top->io_sdram_DQ_write       ;
 		sdramIo->DQ_writeEnable = (CData*)&top->io_sdram_DQ_writeEnable;
-		Sdram *sdram = new Sdram(sdramConfig, sdramIo);
+		sdram = new Sdram(sdramConfig, sdramIo);
+		#ifdef SDRAM_CHECK
+		sdram->setTimings(new SdramTimings(), 20.0);
+		#endif
 
 		axiClk->add(sdram);
 		#ifdef TRACE
@@ -410,7 +807,8 @@ public:
 		//cout << "Simulation caped to " << timeToSec << " of real time"<< endl;
 		#endif
 
-		axiClk->add(new VexRiscvTracer(top->Briey->axi_core_cpu));
+		tracer = new VexRiscvTracer(top->Briey->axi_core_cpu);
+		axiClk->add(tracer);
 
 		#ifdef VGA
 		Vga *vga = new Vga(top,640,480);
@@ -420,6 +818,13 @@ public:
 		top->io_coreInterrupt = 0;
 	}
 
+	virtual ~BrieyWorkspace(){
+		#ifdef SDRAM_STATS
+		sdram->printStats();
+		#endif
+		delete tracer;
+	}
+
 
 	/*bool trigged = false;
 	uint32_t frameStartCounter = 0;
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <atomic>
+#include <thread>
+#include <string>
+#include "spsc_ring.h"
+#include "stdin_ring.h"
+
+//Console of the simulated SoC UART, selected by CONSOLE :
+//- "stdio" : stdin / stdout of the simulation
+//- "pty" : a pseudo terminal, its path is printed at startup (screen /dev/pts/X, expect scripts, ...)
+//- "unix:PATH" : a unix socket server on PATH, which accept one client at the time
+//The simulation only push and pop bytes in rings, an output thread write them by blocks, so there is no syscall nor
+//flush per character. Call flush() to wait until everything written by the simulation was given to the system.
+//In stdio mode, stdin is only read once the simulation polls the console input, so output only consoles (LinuxSoc
+//without WITH_USER_IO) leave it to the rest of the pipeline.
+#ifndef CONSOLE
+#define CONSOLE "stdio"
+#endif
+#define CONSOLE_RING 0x10000
+
+class Console{
+public:
+	SpscRing<uint8_t, CONSOLE_RING> tx, rxRing;
+	SpscRing<uint8_t, CONSOLE_RING> *rx;
+	std::atomic<int> outFd{-1};
+	std::atomic<bool> writing{false};
+	int inFd = -1, serverSocket = -1;
+
+	static Console* get(){
+		static Console *instance = new Console(CONSOLE);
+		return instance;
+	}
+
+	//Returns the next input byte or -1
+	int32_t read(){
+		uint8_t value;
+		if(!rx) rx = &StdinRing::get()->ring;
+		if(!rx->pop(&value)) return -1;
+		return value;
+	}
+
+	void write(uint8_t value){
+		while(!tx.push(value)) usleep(100);
+	}
+
+	void flush(){
+		while(!tx.empty() || writing) usleep(100);
+	}
+
+private:
+	Console(std::string config){
+		rx = &rxRing;
+		if(config == "stdio"){
+			rx = NULL;
+			outFd = STDOUT_FILENO;
+		} else if(config == "pty"){
+			int master = posix_openpt(O_RDWR | O_NOCTTY);
+			if(master == -1 || grantpt(master) || unlockpt(master)) { perror("CONSOLE pty"); exit(1); }
+			//Keep the slave opened, so the master does not get EIO while no terminal is connected
+			int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+			struct termios settings;
+			tcgetattr(slave, &settings);
+			cfmakeraw(&settings);
+			tcsetattr(slave, TCSANOW, &settings);
+			printf("CONSOLE %s\n", ptsname(master));
+			fflush(stdout);
+			fcntl(master, F_SETFL, fcntl(master, F_GETFL, 0) | O_NONBLOCK);
+			inFd = master;
+			outFd = master;
+			std::thread([this](){ input(); }).detach();
+		} else if(config.compare(0, 5, "unix:") == 0){
+			std::string path = config.substr(5);
+			struct sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			unlink(path.c_str());
+			serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+			if(serverSocket == -1 || bind(serverSocket, (struct sockaddr*)&address, sizeof(address)) || listen(serverSocket, 1)) {
+				perror("CONSOLE unix"); exit(1);
+			}
+			printf("CONSOLE %s\n", path.c_str());
+			fflush(stdout);
+			std::thread([this](){ input(); }).detach();
+		} else {
+			printf("CONSOLE %s is not supported, use stdio, pty or unix:PATH\n", config.c_str());
+			exit(1);
+		}
+		std::thread([this](){ output(); }).detach();
+		atexit([](){ Console::get()->flush(); });
+	}
+
+	void input(){
+		uint8_t buffer[4096];
+		while(1){
+			if(serverSocket != -1 && inFd == -1){
+				inFd = accept(serverSocket, NULL, NULL);
+				if(inFd == -1) continue;
+				outFd = inFd;
+			}
+			struct pollfd event = {inFd, POLLIN, 0};
+			poll(&event, 1, -1);
+			int n = ::read(inFd, buffer, sizeof(buffer));
+			if(n <= 0){
+				if(serverSocket != -1){
+					//Client gone, wait for the next one
+					outFd = -1;
+					close(inFd);
+					inFd = -1;
+				} else if(n < 0 && errno != EINTR && errno != EAGAIN) {
+					usleep(10000);
+				}
+				continue;
+			}
+			for(int i = 0;i < n;i++){
+				while(!rx->push(buffer[i])) usleep(100);
+			}
+		}
+	}
+
+	void output(){
+		uint8_t buffer[4096];
+		while(1){
+			uint32_t size = 0;
+			writing = true;
+			while(size != sizeof(buffer) && tx.pop(&buffer[size])) size++;
+			int fd = outFd;
+			//Without client, or when a pty is not read for a while, the output is dropped
+			for(uint32_t offset = 0, retry = 0;offset != size && fd != -1;){
+				int n = ::write(fd, buffer + offset, size - offset);
+				if(n < 0 && (errno == EINTR || errno == EAGAIN) && retry++ < 1000) { usleep(100); continue; }
+				if(n <= 0) break;
+				offset += n;
+			}
+			writing = false;
+			if(size == 0) usleep(1000);
+		}
+	}
+};
@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <time.h>
 #include <unistd.h>
+#include <queue>
 
 using namespace std;
 
@@ -56,6 +57,7 @@ public:
 	CData* reset;
 	uint64_t tooglePeriod;
 	vector<SimElement*> simElements;
+	uint64_t cycles = 0;
 	ClockDomain(CData *clk, CData *reset, uint64_t period, uint64_t delay){
 		this->clk = clk;
 		this->reset = reset;
@@ -72,6 +74,7 @@ public:
 				simElement->preCycle();
 			}
 			postCycle = true;
+			cycles++;
 			*clk = 1;
 			schedule(0);
 		}else{
@@ -123,10 +126,48 @@ public:
 
 };
 
+//Keep the simulation from running faster than speedFactor times the real time. The wall time is only checked every
+//REALTIME_PERIOD of simulated time, and the pacer sleeps when the simulation is ahead.
+#ifndef REALTIME_PERIOD
+#define REALTIME_PERIOD 10000000
+#endif
+class RealTimePacer : public TimeProcess{
+public:
+	double simToWall;
+	double wallStart = -1;
+	uint64_t simElapsed = 0;
+
+	RealTimePacer(double timeToSec, double speedFactor){
+		simToWall = timeToSec/speedFactor;
+		schedule(REALTIME_PERIOD);
+	}
+
+	static double wallTime(){
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return now.tv_sec + now.tv_nsec*1e-9;
+	}
+
+	virtual void tick(){
+		double now = wallTime();
+		if(wallStart < 0) wallStart = now;
+		simElapsed += REALTIME_PERIOD;
+		double ahead = wallStart + simElapsed*simToWall - now;
+		if(ahead > 0){
+			usleep(ahead*1e6);
+		} else if(ahead < -0.01){
+			//Do not try to catch up after the simulation was slower than real time
+			wallStart -= ahead + 0.01;
+		}
+		schedule(REALTIME_PERIOD);
+	}
+};
+
 
 
 class success : public std::exception { };
-static uint32_t workspaceCycles = 0;
+//Clock cycles of the first ClockDomain of the last run workspace
+static uint64_t workspaceCycles = 0;
 template <class T> class Workspace{
 public:
 
@@ -136,7 +177,6 @@ public:
 	bool resetDone = false;
 	double timeToSec = 1e-12;
 	double speedFactor = 1.0;
-	uint64_t allowedTime = 0;
 	string name;
 	uint64_t time = 0;
 	#ifdef TRACE
@@ -189,16 +229,28 @@ public:
 		tfp->open((string(name)+ ".vcd").c_str());
 		#endif
 
-		struct timespec start_time,tick_time;
+		#ifdef PRINT_PERF
+		struct timespec tick_time;
 		uint64_t tickLastSimTime = 0;
-		top->eval();
-
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start_time);
 		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tick_time);
+		#endif
+		#ifdef REALTIME
+		timeProcesses.push_back(new RealTimePacer(timeToSec, speedFactor));
+		#endif
+		top->eval();
 
 		uint32_t flushCounter = 0;
+		#ifndef LINEAR_SCHEDULER
+		//Absolute wake times, ordered by time then by process declaration order
+		typedef pair<uint64_t, uint32_t> Wake;
+		priority_queue<Wake, vector<Wake>, greater<Wake>> wakes;
+		vector<uint32_t> dues;
+		for(uint32_t id = 0;id < timeProcesses.size();id++)
+			if(timeProcesses[id]->wakeEnable) wakes.push(Wake(time + timeProcesses[id]->wakeDelay, id));
+		#endif
 		try {
 			while(1){
+				#ifdef LINEAR_SCHEDULER
 				uint64_t delay = ~0l;
 				for(TimeProcess* p : timeProcesses)
 					if(p->wakeEnable && p->wakeDelay < delay)
@@ -217,35 +269,51 @@ public:
 						p->tick();
 					}
 				}
+				#else
+				if(wakes.empty()){
+					fail();
+				}
+				uint64_t now = wakes.top().first;
+				uint64_t delay = now - time;
+				if(delay != 0){
+					dump(time);
+				}
+				//Tick all the processes due at that time in their declaration order, then schedule their next wake
+				dues.clear();
+				while(!wakes.empty() && wakes.top().first == now){
+					dues.push_back(wakes.top().second);
+					wakes.pop();
+				}
+				for(uint32_t id : dues){
+					TimeProcess* p = timeProcesses[id];
+					p->wakeEnable = false;
+					p->tick();
+				}
+				for(uint32_t id : dues){
+					TimeProcess* p = timeProcesses[id];
+					if(p->wakeEnable) wakes.push(Wake(now + p->wakeDelay, id));
+				}
+				#endif
 
 				top->eval();
 				for(auto* p : checkProcesses) p->tick(time);
+				#ifdef SIM_TIME
+				if(time >= SIM_TIME*1e9) pass();
+				#endif
 
 				if(delay != 0){
+					#ifdef PRINT_PERF
 					if(time - tickLastSimTime > 1000*400000 || time - tickLastSimTime > 1.0*speedFactor/timeToSec){
 						struct timespec end_time;
 						clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_time);
 						uint64_t diffInNanos = end_time.tv_sec*1e9 + end_time.tv_nsec -  tick_time.tv_sec*1e9 - tick_time.tv_nsec;
 						tick_time = end_time;
 						double dt = diffInNanos*1e-9;
-						#ifdef PRINT_PERF
-							printf("Simulation speed : %f ms/realTime\n",(time - tickLastSimTime)/dt*timeToSec*1e3);
-						#endif
+						printf("Simulation speed : %f ms/realTime\n",(time - tickLastSimTime)/dt*timeToSec*1e3);
 						tickLastSimTime = time;
 					}
+					#endif
 					time += delay;
-					while(allowedTime < delay){
-						struct timespec end_time;
-						clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end_time);
-						uint64_t diffInNanos = end_time.tv_sec*1e9 + end_time.tv_nsec -  start_time.tv_sec*1e9 - start_time.tv_nsec;
-						start_time = end_time;
-						double dt = diffInNanos*1e-9;
-						allowedTime += dt*speedFactor/timeToSec;
-						if(allowedTime > 0.01*speedFactor/timeToSec)
-							allowedTime = 0.01*speedFactor/timeToSec;
-
-					}
-					allowedTime-=delay;
 
 					flushCounter++;
 					if(flushCounter > 100000){
@@ -276,6 +344,13 @@ public:
 		#ifdef TRACE
 		tfp->close();
 		#endif
+		for(TimeProcess* p : timeProcesses){
+			ClockDomain *clockDomain = dynamic_cast<ClockDomain*>(p);
+			if(clockDomain){
+				workspaceCycles = clockDomain->cycles;
+				break;
+			}
+		}
 		return this;
 	}
 };
@@ -1,28 +1,14 @@
 
-#include <stdio.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <string.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <netinet/tcp.h>
+#include "tcp_server.h"
 
-/** Returns true on success, or false if there was an error */
-bool SetSocketBlockingEnabled(int fd, bool blocking)
-{
-   if (fd < 0) return false;
-
-#ifdef WIN32
-   unsigned long mode = blocking ? 0 : 1;
-   return (ioctlsocket(fd, FIONBIO, &mode) == 0) ? true : false;
-#else
-   int flags = fcntl(fd, F_GETFL, 0);
-   if (flags < 0) return false;
-   flags = blocking ? (flags&~O_NONBLOCK) : (flags|O_NONBLOCK);
-   return (fcntl(fd, F_SETFL, flags) == 0) ? true : false;
-#endif
-}
+//Besides the historical one byte per edge commands (1 = TMS, 2 = TDI, 4 = read TDO, 8 = TCK), the server accept bulk
+//shifts : JTAG_BULK | flags, the bit count (u32 little endian), the TMS bits then the TDI bits (LSB first). Each bit is
+//applied with TCK low then high, TDO being sampled before the rising edge, and TCK is left low at the end. With
+//JTAG_BULK_TDO, the TDO bits are sent back in one write. Shifts longer than JTAG_BULK_MAX bits are dropped.
+//src/test/python/tool/jtagBulk.py is a client which check the protocol against the legacy one.
+#define JTAG_BULK 0x80
+#define JTAG_BULK_TDO 0x01
+#define JTAG_BULK_MAX 0x100000
 
 class Jtag : public TimeProcess{
 public:
@@ -30,14 +16,18 @@ public:
 	enum State {reset};
 	uint32_t state;
 
-	int serverSocket, clientHandle;
-	struct sockaddr_in serverAddr;
-	struct sockaddr_storage serverStorage;
-	socklen_t addr_size;
+	TcpServer server;
 	uint64_t tooglePeriod;
-//	char buffer[1024];
+	bool txPending = false;
+
+	enum BulkState {BULK_IDLE, BULK_HEADER, BULK_PAYLOAD, BULK_SKIP, BULK_SHIFT};
+	BulkState bulkState = BULK_IDLE;
+	uint8_t bulkFlags;
+	uint32_t bulkCount, bulkHeaderBytes, bulkBit, bulkSkip;
+	bool bulkHigh;
+	vector<uint8_t> bulkPayload, bulkTdo;
 
-	Jtag(CData *tms, CData *tdi, CData *tdo, CData* tck,uint64_t period){
+	Jtag(CData *tms, CData *tdi, CData *tdo, CData* tck,uint64_t period) : server(7894){
 		this->tms = tms;
 		this->tdi = tdi;
 		this->tdo = tdo;
@@ -49,129 +39,99 @@ public:
 		*tck = 0;
 		state = 0;
 		schedule(0);
-
-		//---- Create the socket. The three arguments are: ----//
-		// 1) Internet domain 2) Stream socket 3) Default protocol (TCP in this case) //
-		serverSocket = socket(PF_INET, SOCK_STREAM, 0);
-		assert(serverSocket != -1);
-		int flag = 1;
-		setsockopt(  serverSocket,            /* socket affected */
-					 IPPROTO_TCP,     /* set option at TCP level */
-					 TCP_NODELAY,     /* name of option */
-					 (char *) &flag,  /* the cast is historical
-											 cruft */
-					 sizeof(int));    /* length of option value */
-
-		/*int a = 0xFFF;
-		if (setsockopt(serverSocket, SOL_SOCKET, SO_RCVBUF, &a, sizeof(int)) == -1) {
-		    fprintf(stderr, "Error setting socket opts: %s\n", strerror(errno));
-		}
-		a = 0xFFFFFF;
-		if (setsockopt(serverSocket, SOL_SOCKET, SO_SNDBUF, &a, sizeof(int)) == -1) {
-		    fprintf(stderr, "Error setting socket opts: %s\n", strerror(errno));
-		}*/
-
-		SetSocketBlockingEnabled(serverSocket,0);
-
-
-		//---- Configure settings of the server address struct ----//
-		// Address family = Internet //
-		serverAddr.sin_family = AF_INET;
-		serverAddr.sin_port = htons(7894);
-		serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
-		memset(serverAddr.sin_zero, '\0', sizeof serverAddr.sin_zero);
-
-		//---- Bind the address struct to the socket ----//
-		bind(serverSocket, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
-
-		//---- Listen on the socket, with 5 max connection requests queued ----//
-		listen(serverSocket,1);
-
-		//---- Accept call creates a new socket for the incoming connection ----//
-		addr_size = sizeof serverStorage;
-		clientHandle = -1;
-
-	}
-	void connectionReset(){
-		printf("CONNECTION RESET\n");
-		shutdown(clientHandle,SHUT_RDWR);
-		clientHandle = -1;
 	}
 
+	uint32_t bulkBytes() { return ((uint64_t)bulkCount + 7)/8; }
 
-	virtual ~Jtag(){
-		if(clientHandle != -1) {
-			shutdown(clientHandle,SHUT_RDWR);
-			usleep(100);
+	void bulkShift(){
+		if(bulkBit == bulkCount){
+			*tck = 0;
+			if(bulkFlags & JTAG_BULK_TDO){
+				server.write(&bulkTdo[0], bulkBytes());
+				txPending = true;
+			}
+			bulkState = BULK_IDLE;
+			return;
 		}
-		if(serverSocket != -1) {
-			close(serverSocket);
-			usleep(100);
+		uint32_t byte = bulkBit/8, mask = 1 << (bulkBit%8);
+		if(!bulkHigh){
+			*tck = 0;
+			*tms = (bulkPayload[byte] & mask) != 0;
+			*tdi = (bulkPayload[bulkBytes() + byte] & mask) != 0;
+		} else {
+			if(*tdo) bulkTdo[byte] |= mask;
+			*tck = 1;
+			bulkBit++;
 		}
+		bulkHigh = !bulkHigh;
 	}
 
-	uint32_t selfSleep = 0;
-	uint32_t checkNewConnectionsTimer = 0;
-	uint8_t rxBuffer[100];
-	int32_t rxBufferSize = 0;
-	int32_t rxBufferRemaining = 0;
-	virtual void tick(){
-		checkNewConnectionsTimer++;
-		if(checkNewConnectionsTimer == 5000){
-			checkNewConnectionsTimer = 0;
-			int newclientHandle = accept(serverSocket, (struct sockaddr *) &serverStorage, &addr_size);
-			if(newclientHandle != -1){
-				if(clientHandle != -1){
-					connectionReset();
-				}
-				clientHandle = newclientHandle;
-				printf("CONNECTED\n");
-			}
-			else{
-				if(clientHandle == -1)
-					selfSleep = 1000;
+	//Get the received bytes until one of them drive an edge
+	void receive(){
+		int32_t value;
+		while((value = server.read()) != -1){
+			if(value >= TCP_SERVER_CONNECTED){
+				bulkState = BULK_IDLE;
+				continue;
 			}
-		}
-		if(selfSleep)
-			selfSleep--;
-		else{
-			if(clientHandle != -1){
-				uint8_t buffer;
-				int n;
-
-				if(rxBufferRemaining == 0){
-					if(ioctl(clientHandle,FIONREAD,&n) != 0)
-						connectionReset();
-					else if(n >= 1){
-						rxBufferSize = read(clientHandle,&rxBuffer,100);
-						if(rxBufferSize < 0){
-							connectionReset();
-						}else {
-							rxBufferRemaining = rxBufferSize;
-						}
-					}else {
-						selfSleep = 30;
+			switch(bulkState){
+			case BULK_HEADER:
+				bulkCount |= ((uint32_t)value) << (8*bulkHeaderBytes++);
+				if(bulkHeaderBytes == 4) {
+					bulkPayload.clear();
+					bulkState = bulkCount ? BULK_PAYLOAD : BULK_IDLE;
+					if(bulkCount > JTAG_BULK_MAX){
+						printf("JTAG bulk shift of %u bits dropped, the maximum is %u\n", bulkCount, JTAG_BULK_MAX);
+						bulkSkip = 2*bulkBytes();
+						bulkState = BULK_SKIP;
 					}
 				}
-
-				if(rxBufferRemaining != 0){
-					uint8_t buffer = rxBuffer[rxBufferSize - (rxBufferRemaining--)];
-					*tms = (buffer & 1) != 0;
-					*tdi = (buffer & 2) != 0;
-					*tck = (buffer & 8) != 0;
-					if(buffer & 4){
-						buffer = (*tdo != 0);
-						//printf("TDO=%d\n",buffer);
-						if(-1 == send(clientHandle,&buffer,1,0))
-							connectionReset();
-					}else {
-
-					//	printf("\n");
-					}
+				continue;
+			case BULK_SKIP:
+				if(--bulkSkip == 0) bulkState = BULK_IDLE;
+				continue;
+			case BULK_PAYLOAD:
+				bulkPayload.push_back(value);
+				if(bulkPayload.size() == 2*bulkBytes()){
+					bulkTdo.assign(bulkBytes(), 0);
+					bulkBit = 0;
+					bulkHigh = false;
+					bulkState = BULK_SHIFT;
+					return;
 				}
+				continue;
+			default: break;
 			}
+
+			uint8_t buffer = value;
+			if(buffer & JTAG_BULK){
+				bulkFlags = buffer;
+				bulkCount = 0;
+				bulkHeaderBytes = 0;
+				bulkState = BULK_HEADER;
+				continue;
+			}
+			*tms = (buffer & 1) != 0;
+			*tdi = (buffer & 2) != 0;
+			*tck = (buffer & 8) != 0;
+			if(buffer & 4){
+				buffer = (*tdo != 0);
+				//printf("TDO=%d\n",buffer);
+				server.write(buffer);
+				txPending = true;
+			}
+			return;
+		}
+	}
+
+	//The TDO samples are sent together once all the received bytes are applied
+	virtual void tick(){
+		if(bulkState == BULK_SHIFT) bulkShift(); else receive();
+		if(txPending && !server.readable() && bulkState != BULK_SHIFT){
+			server.flush();
+			txPending = false;
 		}
 		schedule(tooglePeriod);
 	}
 
-};
\ No newline at end of file
+};
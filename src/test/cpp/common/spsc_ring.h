@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+//Lock free single producer / single consumer ring, SIZE has to be a power of two
+template <typename T, uint32_t SIZE>
+class SpscRing{
+public:
+	T buffer[SIZE];
+	std::atomic<uint32_t> head{0}, tail{0};
+
+	bool push(T value){
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) == SIZE) return false;
+		buffer[h & (SIZE-1)] = value;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T *value){
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire)) return false;
+		*value = buffer[t & (SIZE-1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+	bool full() { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire) == SIZE; }
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <unistd.h>
+#include <thread>
+#include "spsc_ring.h"
+
+//Bytes of stdin, read by blocks from a single input thread. Polling it from the simulation is only a couple of atomic
+//loads, without syscall nor lock. Stdin can be the terminal or a file / pipe to script a console session, in which case
+//the input thread waits for the simulation to consume the bytes instead of dropping them.
+#define STDIN_RING_SIZE 0x10000
+
+class StdinRing{
+public:
+	SpscRing<uint8_t, STDIN_RING_SIZE> ring;
+
+	static StdinRing* get(){
+		static StdinRing *instance = new StdinRing();
+		return instance;
+	}
+
+	bool pop(uint8_t *value) { return ring.pop(value); }
+	bool empty() { return ring.empty(); }
+
+private:
+	StdinRing(){
+		std::thread([this](){ run(); }).detach();
+	}
+
+	void run(){
+		uint8_t buffer[4096];
+		while(1){
+			int n = read(STDIN_FILENO, buffer, sizeof(buffer));
+			if(n <= 0) return;
+			for(int i = 0;i < n;i++){
+				while(!ring.push(buffer[i])) usleep(100);
+			}
+		}
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <thread>
+#include "spsc_ring.h"
+
+/** Returns true on success, or false if there was an error */
+bool SetSocketBlockingEnabled(int fd, bool blocking)
+{
+   if (fd < 0) return false;
+
+#ifdef WIN32
+   unsigned long mode = blocking ? 0 : 1;
+   return (ioctlsocket(fd, FIONBIO, &mode) == 0) ? true : false;
+#else
+   int flags = fcntl(fd, F_GETFL, 0);
+   if (flags < 0) return false;
+   flags = blocking ? (flags&~O_NONBLOCK) : (flags|O_NONBLOCK);
+   return (fcntl(fd, F_SETFL, flags) == 0) ? true : false;
+#endif
+}
+
+//Single client TCP server whose sockets are only touched by an epoll I/O thread. The simulation exchanges bytes with
+//it through two rings, so polling an idle server is only a couple of atomic loads. The connections and disconnections
+//are given in order with the received bytes as TCP_SERVER_CONNECTED / TCP_SERVER_DISCONNECTED, and the simulation
+//push back TCP_SERVER_CONNECTED when it read a connection, so the bytes sent for an old client are never given to a new
+//one. A new client replace the current one.
+#define TCP_SERVER_CONNECTED 0x100
+#define TCP_SERVER_DISCONNECTED 0x101
+#define TCP_SERVER_RING 0x10000
+
+class TcpServer{
+public:
+	SpscRing<uint16_t, TCP_SERVER_RING> rx, tx;
+	int serverSocket, clientHandle = -1, epollFd, wakeFd;
+	std::atomic<bool> stop{false};
+	std::thread *ioThread;
+	uint32_t connections = 0, txConnections = 0;
+	bool rxArmed = true;
+
+	TcpServer(uint16_t port){
+		serverSocket = socket(PF_INET, SOCK_STREAM, 0);
+		assert(serverSocket != -1);
+		int flag = 1;
+		setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(int));
+		SetSocketBlockingEnabled(serverSocket,0);
+
+		struct sockaddr_in serverAddr;
+		serverAddr.sin_family = AF_INET;
+		serverAddr.sin_port = htons(port);
+		serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		memset(serverAddr.sin_zero, '\0', sizeof serverAddr.sin_zero);
+		bind(serverSocket, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
+		listen(serverSocket,1);
+
+		epollFd = epoll_create1(0);
+		wakeFd = eventfd(0, EFD_NONBLOCK);
+		watch(serverSocket, EPOLLIN, EPOLL_CTL_ADD);
+		watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+		ioThread = new std::thread([this](){ run(); });
+	}
+
+	virtual ~TcpServer(){
+		stop = true;
+		wake();
+		ioThread->join();
+		delete ioThread;
+		if(clientHandle != -1) {
+			shutdown(clientHandle,SHUT_RDWR);
+			close(clientHandle);
+		}
+		close(serverSocket);
+		close(epollFd);
+		close(wakeFd);
+	}
+
+	//Simulation side
+	//Returns the next received byte, TCP_SERVER_CONNECTED, TCP_SERVER_DISCONNECTED or -1 when there is nothing
+	int32_t read(){
+		uint16_t value;
+		if(!rx.pop(&value)) return -1;
+		if(value == TCP_SERVER_CONNECTED) write(TCP_SERVER_CONNECTED);
+		return value;
+	}
+	bool readable() { return !rx.empty(); }
+	void write(uint16_t value) { while(!tx.push(value)) wake(); }
+	void write(const void *data, uint32_t size) { for(uint32_t i = 0;i < size;i++) write(((uint8_t*)data)[i]); }
+	//Get the I/O thread sending what was written
+	void flush() { wake(); }
+
+
+	void wake(){
+		uint64_t one = 1;
+		if(::write(wakeFd, &one, 8) != 8) {}
+	}
+
+	void watch(int fd, uint32_t events, int op){
+		struct epoll_event event;
+		event.events = events;
+		event.data.fd = fd;
+		epoll_ctl(epollFd, op, fd, &event);
+	}
+
+	//I/O thread side
+	void disconnect(){
+		printf("CONNECTION RESET\n");
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, clientHandle, NULL);
+		shutdown(clientHandle,SHUT_RDWR);
+		close(clientHandle);
+		clientHandle = -1;
+		rxArmed = true;
+		while(!rx.push(TCP_SERVER_DISCONNECTED)) usleep(100);
+	}
+
+	void accept(){
+		int handle = ::accept(serverSocket, NULL, NULL);
+		if(handle == -1) return;
+		if(clientHandle != -1) disconnect();
+		int flag = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int));
+		SetSocketBlockingEnabled(handle,0);
+		clientHandle = handle;
+		connections++;
+		printf("CONNECTED\n");
+		while(!rx.push(TCP_SERVER_CONNECTED)) usleep(100);
+		watch(clientHandle, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+	}
+
+	void receive(){
+		uint8_t buffer[4096];
+		uint32_t room = TCP_SERVER_RING - (rx.head.load() - rx.tail.load());
+		if(room == 0) return;
+		if(room > sizeof(buffer)) room = sizeof(buffer);
+		int n = recv(clientHandle, buffer, room, 0);
+		if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)){
+			disconnect();
+			return;
+		}
+		for(int i = 0;i < n;i++) rx.push(buffer[i]);
+	}
+
+	void send(){
+		uint8_t buffer[4096];
+		uint32_t size = 0;
+		uint16_t value;
+		while(tx.pop(&value)){
+			if(value == TCP_SERVER_CONNECTED) {
+				txConnections++;
+				continue;
+			}
+			if(txConnections != connections || clientHandle == -1) continue;
+			buffer[size++] = value;
+			if(size == sizeof(buffer)){
+				sendAll(buffer, size);
+				size = 0;
+			}
+		}
+		if(size) sendAll(buffer, size);
+	}
+
+	void sendAll(uint8_t *buffer, uint32_t size){
+		for(uint32_t offset = 0;offset != size && clientHandle != -1;){
+			int n = ::send(clientHandle, buffer + offset, size - offset, MSG_NOSIGNAL);
+			if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { usleep(10); continue; }
+			if(n <= 0) { disconnect(); return; }
+			offset += n;
+		}
+	}
+
+	void run(){
+		while(!stop){
+			struct epoll_event events[4];
+			//When the simulation does not consume the received bytes fast enough, stop watching the client until
+			//there is room again
+			bool full = rx.full();
+			if(clientHandle != -1 && full == rxArmed){
+				rxArmed = !full;
+				watch(clientHandle, rxArmed ? (EPOLLIN | EPOLLRDHUP) : EPOLLRDHUP, EPOLL_CTL_MOD);
+			}
+			int count = epoll_wait(epollFd, events, 4, rxArmed ? -1 : 1);
+			for(int i = 0;i < count;i++){
+				int fd = events[i].data.fd;
+				if(fd == serverSocket){
+					accept();
+				} else if(fd == wakeFd){
+					uint64_t value;
+					if(::read(wakeFd, &value, 8) != 8) {}
+				} else if(fd == clientHandle){
+					if(events[i].events & EPOLLIN) receive();
+					else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) disconnect();
+				}
+			}
+			send();
+		}
+	}
+};
@@ -1,14 +1,16 @@
 
-
+#include "console.h"
 
 class UartRx : public TimeProcess{
 public:
 
 	CData *rx;
 	uint32_t uartTimeRate;
+	Console *console;
 	UartRx(CData *rx, uint32_t uartTimeRate){
 		this->rx = rx;
 		this->uartTimeRate = uartTimeRate;
+		console = Console::get();
 		schedule(uartTimeRate);
 	}
 
@@ -39,7 +41,7 @@ public:
 			break;
 			case STOP:
 				if(*rx){
-					cout << data << flush;
+					console->write(data);
 				} else {
 					cout << "UART RX FRAME ERROR at " << time << endl;
 				}
@@ -51,10 +53,6 @@ public:
 	}
 };
 
-#include<pthread.h>
-#include <mutex>
-#include <queue>
-
 class UartTx : public TimeProcess{
 public:
 
@@ -65,46 +63,27 @@ public:
 	State state = START;
 	char data;
 	uint32_t counter;
-	pthread_t inputThreadId;
-	queue<uint8_t> inputsQueue;
-	mutex inputsMutex;
+	Console *console;
 
 	UartTx(CData *tx, uint32_t uartTimeRate){
 		this->tx = tx;
 		this->uartTimeRate = uartTimeRate;
 		schedule(uartTimeRate);
-		pthread_create(&inputThreadId, NULL, &inputThreadWrapper, this);
+		console = Console::get();
 		*tx = 1;
 	}
 
-	static void* inputThreadWrapper(void *uartTx){
-		((UartTx*)uartTx)->inputThread();
-		return NULL;
-	}
-
-	void inputThread(){
-		while(1){
-			uint8_t c = getchar();
-			inputsMutex.lock();
-			inputsQueue.push(c);
-			inputsMutex.unlock();
-		}
-	}
-
 	virtual void tick(){
 		switch(state){
 			case START:
-				inputsMutex.lock();
-				if(!inputsQueue.empty()){
-					data = inputsQueue.front();
-					inputsQueue.pop();
-					inputsMutex.unlock();
+				int32_t c;
+				if((c = console->read()) != -1){
+					data = c;
 					state = DATA;
 					counter = 0;
 					*tx = 0;
 					schedule(uartTimeRate);
 				} else {
-					inputsMutex.unlock();
 					schedule(uartTimeRate*50);
 				}
 			break;
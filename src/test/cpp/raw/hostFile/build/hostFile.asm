@@ -0,0 +1,165 @@
+
+build/hostFile.elf:	file format elf32-littleriscv
+
+Disassembly of section .crt_section:
+
+80000000 <_start>:
+80000000: 93 0d 00 fd  	li	s11, -48
+80000004: 13 0e 10 00  	li	t3, 1
+80000008: 17 05 00 00  	auipc	a0, 0
+8000000c: 13 05 85 10  	addi	a0, a0, 264
+80000010: 23 a0 ad 00  	sw	a0, 0(s11)
+80000014: 83 a5 4d 00  	lw	a1, 4(s11)
+80000018: 13 06 00 01  	li	a2, 16
+8000001c: 63 94 c5 0a  	bne	a1, a2, 0x800000c4 <fail>
+80000020: 83 25 45 01  	lw	a1, 20(a0)
+80000024: 63 90 c5 0a  	bne	a1, a2, 0x800000c4 <fail>
+80000028: 13 0e 20 00  	li	t3, 2
+8000002c: 17 05 00 00  	auipc	a0, 0
+80000030: 13 05 c5 0f  	addi	a0, a0, 252
+80000034: 23 a0 ad 00  	sw	a0, 0(s11)
+80000038: 83 a5 4d 00  	lw	a1, 4(s11)
+8000003c: 13 06 00 01  	li	a2, 16
+80000040: 63 92 c5 08  	bne	a1, a2, 0x800000c4 <fail>
+80000044: 13 0e 30 00  	li	t3, 3
+80000048: 17 05 00 00  	auipc	a0, 0
+8000004c: 13 05 85 0f  	addi	a0, a0, 248
+80000050: 23 a0 ad 00  	sw	a0, 0(s11)
+80000054: 83 a5 4d 00  	lw	a1, 4(s11)
+80000058: 13 06 c0 00  	li	a2, 12
+8000005c: 63 94 c5 06  	bne	a1, a2, 0x800000c4 <fail>
+80000060: 97 06 00 00  	auipc	a3, 0
+80000064: 93 86 46 0a  	addi	a3, a3, 164
+80000068: 37 37 00 80  	lui	a4, 524291
+
+8000006c <readCheck>:
+8000006c: 83 c7 06 00  	lbu	a5, 0(a3)
+80000070: 03 48 07 00  	lbu	a6, 0(a4)
+80000074: 63 98 07 05  	bne	a5, a6, 0x800000c4 <fail>
+80000078: 93 86 16 00  	addi	a3, a3, 1
+8000007c: 13 07 17 00  	addi	a4, a4, 1
+80000080: 13 06 f6 ff  	addi	a2, a2, -1
+80000084: e3 14 06 fe  	bnez	a2, 0x8000006c <readCheck>
+80000088: 13 0e 40 00  	li	t3, 4
+8000008c: 17 05 00 00  	auipc	a0, 0
+80000090: 13 05 c5 0c  	addi	a0, a0, 204
+80000094: 23 a0 ad 00  	sw	a0, 0(s11)
+80000098: 83 a5 4d 00  	lw	a1, 4(s11)
+8000009c: 13 06 f0 ff  	li	a2, -1
+800000a0: 63 92 c5 02  	bne	a1, a2, 0x800000c4 <fail>
+800000a4: 13 0e 50 00  	li	t3, 5
+800000a8: 17 05 00 00  	auipc	a0, 0
+800000ac: 13 05 85 0c  	addi	a0, a0, 200
+800000b0: 23 a0 ad 00  	sw	a0, 0(s11)
+800000b4: 83 a5 4d 00  	lw	a1, 4(s11)
+800000b8: 13 06 f0 ff  	li	a2, -1
+800000bc: 63 94 c5 00  	bne	a1, a2, 0x800000c4 <fail>
+800000c0: 6f 00 00 01  	j	0x800000d0 <pass>
+
+800000c4 <fail>:
+800000c4: 37 01 10 f0  	lui	sp, 983296
+800000c8: 13 01 41 f2  	addi	sp, sp, -220
+800000cc: 23 20 c1 01  	sw	t3, 0(sp)
+
+800000d0 <pass>:
+800000d0: 37 01 10 f0  	lui	sp, 983296
+800000d4: 13 01 01 f2  	addi	sp, sp, -224
+800000d8: 23 20 01 00  	sw	zero, 0(sp)
+800000dc: 13 00 00 00  	nop
+800000e0: 13 00 00 00  	nop
+800000e4: 13 00 00 00  	nop
+800000e8: 13 00 00 00  	nop
+800000ec: 13 00 00 00  	nop
+800000f0: 13 00 00 00  	nop
+800000f4: 13 00 00 00  	nop
+800000f8: 13 00 00 00  	nop
+800000fc: 13 00 00 00  	nop
+
+80000100 <pattern>:
+80000100: 00 01        	<unknown>
+80000102: 02 03        	<unknown>
+80000104: 04 05        	<unknown>
+80000106: 06 07        	<unknown>
+80000108: 08 09        	<unknown>
+8000010a: 0a 0b        	<unknown>
+8000010c: 0c 0d        	<unknown>
+8000010e: 0e 0f        	<unknown>
+
+80000110 <writeDescriptor>:
+80000110: 02 00        	<unknown>
+80000112: 00 00        	<unknown>
+80000114: 88 01        	<unknown>
+80000116: 00 80        	<unknown>
+80000118: 00 00        	<unknown>
+8000011a: 00 00        	<unknown>
+8000011c: 00 01        	<unknown>
+8000011e: 00 80        	<unknown>
+80000120: 10 00        	<unknown>
+80000122: 00 00        	<unknown>
+80000124: 00 00        	<unknown>
+80000126: 00 00        	<unknown>
+
+80000128 <sizeDescriptor>:
+80000128: 03 00 00 00  	lb	zero, 0(zero)
+8000012c: 88 01        	<unknown>
+8000012e: 00 80        	<unknown>
+		...
+
+80000140 <readDescriptor>:
+80000140: 01 00        	<unknown>
+80000142: 00 00        	<unknown>
+80000144: 88 01        	<unknown>
+80000146: 00 80        	<unknown>
+80000148: 04 00        	<unknown>
+8000014a: 00 00        	<unknown>
+8000014c: 00 30        	<unknown>
+8000014e: 00 80        	<unknown>
+80000150: 10 00        	<unknown>
+80000152: 00 00        	<unknown>
+80000154: 00 00        	<unknown>
+80000156: 00 00        	<unknown>
+
+80000158 <hugeDescriptor>:
+80000158: 01 00        	<unknown>
+8000015a: 00 00        	<unknown>
+8000015c: 88 01        	<unknown>
+8000015e: 00 80        	<unknown>
+80000160: 00 00        	<unknown>
+80000162: 00 00        	<unknown>
+80000164: 00 30        	<unknown>
+80000166: 00 80        	<unknown>
+80000168: 00 00        	<unknown>
+8000016a: 00 80        	<unknown>
+8000016c: 00 00        	<unknown>
+8000016e: 00 00        	<unknown>
+
+80000170 <escapeDescriptor>:
+80000170: 01 00        	<unknown>
+80000172: 00 00        	<unknown>
+80000174: 95 01        	<unknown>
+80000176: 00 80        	<unknown>
+80000178: 00 00        	<unknown>
+8000017a: 00 00        	<unknown>
+8000017c: 00 30        	<unknown>
+8000017e: 00 80        	<unknown>
+80000180: 10 00        	<unknown>
+80000182: 00 00        	<unknown>
+80000184: 00 00        	<unknown>
+80000186: 00 00        	<unknown>
+
+80000188 <name>:
+80000188: 68 6f        	<unknown>
+8000018a: 73 74 46 69  	csrrci	s0, 1684, 12
+8000018e: 6c 65        	<unknown>
+80000190: 2e 62        	<unknown>
+80000192: 69 6e        	<unknown>
+80000194: 00 2e        	<unknown>
+
+80000195 <escapeName>:
+80000195: 2e 2e        	<unknown>
+80000197: 2f 68 6f 73  	<unknown>
+8000019b: 74 46        	<unknown>
+8000019d: 69 6c        	<unknown>
+8000019f: 65 2e        	<unknown>
+800001a1: 62 69        	<unknown>
+800001a3: 6e 00        	<unknown>
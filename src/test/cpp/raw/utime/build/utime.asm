@@ -0,0 +1,53 @@
+
+build/utime.elf:	file format elf32-littleriscv
+
+Disassembly of section .crt_section:
+
+80000000 <_start>:
+80000000: b7 0d 10 f0  	lui	s11, 983296
+80000004: 93 8d 0d f4  	addi	s11, s11, -192
+80000008: 13 0e 10 00  	li	t3, 1
+8000000c: 03 a5 0d 00  	lw	a0, 0(s11)
+80000010: f3 25 10 c0  	rdtime	a1
+80000014: 33 86 a5 40  	sub	a2, a1, a0
+80000018: 93 06 80 3e  	li	a3, 1000
+8000001c: 63 78 d6 04  	bgeu	a2, a3, 0x8000006c <fail>
+80000020: 13 0e 20 00  	li	t3, 2
+80000024: 03 a5 4d 00  	lw	a0, 4(s11)
+80000028: f3 25 10 c8  	rdtimeh	a1
+8000002c: 63 10 b5 04  	bne	a0, a1, 0x8000006c <fail>
+80000030: 13 0e 30 00  	li	t3, 3
+80000034: 73 25 10 c0  	rdtime	a0
+80000038: 13 06 40 06  	li	a2, 100
+
+8000003c <delay>:
+8000003c: 13 06 f6 ff  	addi	a2, a2, -1
+80000040: e3 1e 06 fe  	bnez	a2, 0x8000003c <delay>
+80000044: f3 25 10 c0  	rdtime	a1
+80000048: 63 72 b5 02  	bgeu	a0, a1, 0x8000006c <fail>
+8000004c: 13 0e 40 00  	li	t3, 4
+
+80000050 <retry>:
+80000050: 73 25 10 c8  	rdtimeh	a0
+80000054: f3 25 10 c0  	rdtime	a1
+80000058: 73 26 10 c8  	rdtimeh	a2
+8000005c: e3 1a c5 fe  	bne	a0, a2, 0x80000050 <retry>
+80000060: 83 a6 4d 00  	lw	a3, 4(s11)
+80000064: 63 e4 a6 00  	bltu	a3, a0, 0x8000006c <fail>
+80000068: 6f 00 00 01  	j	0x80000078 <pass>
+
+8000006c <fail>:
+8000006c: 37 01 10 f0  	lui	sp, 983296
+80000070: 13 01 41 f2  	addi	sp, sp, -220
+80000074: 23 20 c1 01  	sw	t3, 0(sp)
+
+80000078 <pass>:
+80000078: 37 01 10 f0  	lui	sp, 983296
+8000007c: 13 01 01 f2  	addi	sp, sp, -224
+80000080: 23 20 01 00  	sw	zero, 0(sp)
+80000084: 13 00 00 00  	nop
+80000088: 13 00 00 00  	nop
+8000008c: 13 00 00 00  	nop
+80000090: 13 00 00 00  	nop
+80000094: 13 00 00 00  	nop
+80000098: 13 00 00 00  	nop
@@ -17,6 +17,12 @@
 #include <mutex>
 #include <iomanip>
 #include <queue>
+#include <map>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
 #include <time.h>
 #include "encoding.h"
 
@@ -210,6 +216,9 @@ class success : public std::exception { };
 #define MINSTRET   0xB02 // MRW Machine instructions-retired counter.
 #define MCYCLEH    0xB80 // MRW Upper 32 bits of mcycle, RV32I only.
 #define MINSTRETH  0xB82 // MRW Upper 32 bits of minstret, RV32I only.
+#define UTIME      0xC01 // URO Timer for RDTIME instruction.
+#define UTIMEH     0xC81 // URO Upper 32 bits of time, RV32I only.
+#define UTIME_WINDOW 1000 //mTime cycles between the DUT utime sampling and the golden model commit
 
 
 #define SSTATUS 0x100
@@ -425,6 +434,9 @@ public:
 
 	enum AccessKind {READ,WRITE,EXECUTE,READ_WRITE};
 	virtual bool isMmuRegion(uint32_t v) = 0;
+	//Notified before the privilege changes
+	virtual void onTrap(bool interrupt, int32_t cause, uint32_t value, uint32_t fromPrivilege, uint32_t toPrivilege) {}
+	virtual void onMret(uint32_t toPrivilege) {}
 	bool v2p(uint32_t v, uint32_t *p, AccessKind kind){
 	    uint32_t effectivePrivilege = status.mprv && kind != EXECUTE ? status.mpp : privilege;
 		if(effectivePrivilege == 3 || satp.mode == 0 || !isMmuRegion(v)){
@@ -509,6 +521,7 @@ public:
 			break;
 		}
 
+		onTrap(interrupt, cause, valueWrite ? value : 0, privilege, targetPrivilege);
 		privilege = targetPrivilege;
 		pcWrite(xtvec.base << 2);
 		if(interrupt) livenessInterrupt = 0;
@@ -830,6 +843,7 @@ public:
 					switch(i){
 					case 0x30200073:{ //MRET
 						if(privilege < 3){ ilegalInstruction(); return;}
+						onMret(status.mpp);
 						privilege = status.mpp;
 						status.mie = status.mpie;
 						status.mpie = 1;
@@ -1073,6 +1087,545 @@ public:
 
 
 
+#ifdef BENCH
+class BenchResult{
+public:
+	string name;
+	bool iStall, dStall;
+	uint64_t cycles, instructions;
+	double dmipsPerMhz, coremarkPerMhz;
+};
+
+class Bench{
+public:
+	static vector<BenchResult> results;
+
+	//Return the number following the ':' of the last occurrence of key in the log, or -1
+	static double parse(string &log, const char *key){
+		size_t keyAt = log.rfind(key);
+		if(keyAt == string::npos) return -1;
+		size_t valueAt = log.find(':', keyAt);
+		if(valueAt == string::npos) return -1;
+		return strtod(log.c_str() + valueAt + 1, NULL);
+	}
+
+	static void add(string name, bool iStall, bool dStall, uint64_t cycles, uint64_t instructions){
+		BenchResult r;
+		r.name = name;
+		r.iStall = iStall;
+		r.dStall = dStall;
+		r.cycles = cycles;
+		r.instructions = instructions;
+
+		ifstream logFile((name + ".logTrace").c_str());
+		string log((istreambuf_iterator<char>(logFile)), istreambuf_iterator<char>());
+		r.dmipsPerMhz = parse(log, "DMIPS per Mhz");
+		double iterations = parse(log, "Iterations");
+		double ticks = parse(log, "Total ticks");
+		r.coremarkPerMhz = iterations > 0 && ticks > 0 ? 1e6*iterations/ticks : -1;
+
+		cout << "BENCH " << name << " cycles=" << cycles << " IPC=" << (double)instructions/cycles;
+		if(r.dmipsPerMhz >= 0) cout << " DMIPS/Mhz=" << r.dmipsPerMhz;
+		if(r.coremarkPerMhz >= 0) cout << " Coremark/Mhz=" << r.coremarkPerMhz;
+		cout << endl;
+		results.push_back(r);
+	}
+
+	static void dump(string path){
+		ofstream json(path.c_str());
+		json << "{" << endl;
+		json << "  \"config\": \"" << BENCH_CONFIG << "\"," << endl;
+		json << "  \"results\": [" << endl;
+		for(uint32_t idx = 0;idx < results.size();idx++){
+			BenchResult &r = results[idx];
+			json << "    {\"name\": \"" << r.name << "\"";
+			json << ", \"iStall\": " << (r.iStall ? "true" : "false");
+			json << ", \"dStall\": " << (r.dStall ? "true" : "false");
+			json << ", \"cycles\": " << r.cycles;
+			json << ", \"instructions\": " << r.instructions;
+			json << ", \"ipc\": " << (double)r.instructions/r.cycles;
+			if(r.dmipsPerMhz >= 0) json << ", \"dmipsPerMhz\": " << r.dmipsPerMhz;
+			if(r.coremarkPerMhz >= 0) json << ", \"coremarkPerMhz\": " << r.coremarkPerMhz;
+			json << "}" << (idx + 1 != results.size() ? "," : "") << endl;
+		}
+		json << "  ]" << endl;
+		json << "}" << endl;
+		cout << "Benchmark results written in " << path << endl;
+	}
+};
+vector<BenchResult> Bench::results;
+#endif
+
+//Tags of a set associative cache, the data itself stay in the flat Memory
+class CacheModel{
+public:
+	enum Replacement {LRU, FIFO, RANDOM};
+	uint32_t sets, ways, lineShift;
+	Replacement replacement;
+	vector<uint32_t> lines;  //Line address of each way, -1 when invalid
+	vector<uint64_t> stamps; //Last access (LRU) or refill (FIFO) time of each way
+	uint64_t clock = 0, randomState = 0x12345678;
+	uint64_t hits = 0, misses = 0;
+
+	CacheModel(uint32_t size, uint32_t ways, uint32_t lineSize, Replacement replacement){
+		this->ways = ways;
+		this->replacement = replacement;
+		lineShift = 0;
+		while((1u << lineShift) < lineSize) lineShift++;
+		sets = size / lineSize / ways;
+		lines.resize(sets*ways, -1);
+		stamps.resize(sets*ways, 0);
+	}
+
+	//Return true on hit, allocate the line on miss if asked
+	bool access(uint32_t address, bool allocate = true){
+		uint32_t line = address >> lineShift;
+		uint32_t *setLines = &lines[(line % sets)*ways];
+		uint64_t *setStamps = &stamps[(line % sets)*ways];
+		clock++;
+		for(uint32_t way = 0;way < ways;way++){
+			if(setLines[way] == line){
+				hits++;
+				if(replacement == LRU) setStamps[way] = clock;
+				return true;
+			}
+		}
+		misses++;
+		if(allocate){
+			uint32_t victim = 0;
+			while(victim < ways && setLines[victim] != (uint32_t)-1) victim++;
+			if(victim == ways){
+				if(replacement == RANDOM){
+					randomState ^= randomState << 13;
+					randomState ^= randomState >> 7;
+					randomState ^= randomState << 17;
+					victim = randomState % ways;
+				} else {
+					victim = 0;
+					for(uint32_t way = 1;way < ways;way++) if(setStamps[way] < setStamps[victim]) victim = way;
+				}
+			}
+			setLines[victim] = line;
+			setStamps[victim] = clock;
+		}
+		return false;
+	}
+
+	uint32_t occupancy(){
+		uint32_t valids = 0;
+		for(uint32_t line : lines) if(line != (uint32_t)-1) valids++;
+		return valids;
+	}
+};
+
+#if defined(SHADOW_ICACHE) || defined(SHADOW_DCACHE)
+//Shadow a cache geometry with the accesses retired by the golden model. Misses are classified as compulsory (line
+//never seen), capacity (also missing in a fully associative LRU cache of the same size) or conflict.
+class ShadowCache{
+public:
+	string geometry;
+	CacheModel cache;
+	uint32_t lineSize, lineCount;
+	list<uint32_t> lruLines;
+	unordered_map<uint32_t, list<uint32_t>::iterator> lruMap;
+	unordered_set<uint32_t> seen;
+	uint64_t reads = 0, misses = 0, compulsory = 0, capacity = 0, conflict = 0, writes = 0, writeHits = 0;
+
+	ShadowCache(string geometry, uint32_t size, uint32_t ways, uint32_t lineSize) : cache(size, ways, lineSize, CacheModel::LRU){
+		this->geometry = geometry;
+		this->lineSize = lineSize;
+		lineCount = size / lineSize;
+	}
+
+	bool lruAccess(uint32_t line, bool allocate){
+		auto e = lruMap.find(line);
+		if(e != lruMap.end()){
+			lruLines.splice(lruLines.begin(), lruLines, e->second);
+			return true;
+		}
+		if(allocate){
+			lruLines.push_front(line);
+			lruMap[line] = lruLines.begin();
+			if(lruLines.size() > lineCount){
+				lruMap.erase(lruLines.back());
+				lruLines.pop_back();
+			}
+		}
+		return false;
+	}
+
+	//Reads refill the cache, writes are write-through and only update the hit line
+	void access(uint32_t address, bool wr){
+		uint32_t line = address / lineSize;
+		bool hit = cache.access(address, !wr);
+		bool lruHit = lruAccess(line, !wr);
+		if(wr){
+			writes++;
+			if(hit) writeHits++;
+			return;
+		}
+		reads++;
+		if(hit) return;
+		misses++;
+		if(seen.insert(line).second) compulsory++;
+		else if(!lruHit) capacity++;
+		else conflict++;
+	}
+
+	void report(ostream &out){
+		out << "  " << geometry << " : reads=" << reads << " misses=" << misses << " missRate=" << 100.0*misses/max<uint64_t>(1, reads) << "%";
+		out << " compulsory=" << compulsory << " capacity=" << capacity << " conflict=" << conflict;
+		out << " missCycles=" << misses*(SHADOW_MISS_PENALTY + lineSize/4);
+		if(writes) out << " writes=" << writes << " writeHits=" << writeHits;
+		out << endl;
+	}
+
+	//Build the caches of a "size:ways:lineSize[,size:ways:lineSize]*" list
+	static vector<ShadowCache*> parse(string geometries){
+		vector<ShadowCache*> caches;
+		stringstream stream(geometries);
+		string geometry;
+		while(getline(stream, geometry, ',')){
+			uint32_t size, ways, lineSize;
+			if(sscanf(geometry.c_str(), "%u:%u:%u", &size, &ways, &lineSize) != 3){
+				cout << "Bad shadow cache geometry " << geometry << endl;
+				exit(1);
+			}
+			caches.push_back(new ShadowCache(geometry, size, ways, lineSize));
+		}
+		return caches;
+	}
+};
+#endif
+
+//Decide cycle by cycle when the simulated memory accept the bus commands and complete their data beats
+class BusTiming{
+public:
+	virtual ~BusTiming(){}
+	//Called once per cycle by the Workspace, before the bus front-ends, for the models progressing on their own
+	virtual void tick() {}
+	//Can a new command be accepted this cycle
+	virtual bool cmdReady() { return true; }
+	//The master had a command waiting which was not accepted this cycle
+	virtual void cmdStall() {}
+	//A command was accepted, for writes the first data beat come with it
+	virtual void cmd(uint32_t address, uint32_t beats, bool wr) {}
+	//Can the next read response beat complete this cycle
+	virtual bool rspReady() { return true; }
+	//The read response beat completed
+	virtual void rspFire() {}
+	//Can the next write data beat (or single beat write acknowledge) complete this cycle
+	virtual bool writeReady() { return true; }
+	//The write data beat completed
+	virtual void writeFire() {}
+};
+
+//Historical random back-pressure of the testbench
+class BusTimingRandom : public BusTiming{
+public:
+	virtual bool cmdReady() { return VL_RANDOM_I(7) < 100; }
+	virtual bool rspReady() { return VL_RANDOM_I(7) < 100; }
+	virtual bool writeReady() { return VL_RANDOM_I(7) < 100; }
+};
+
+#ifdef TIMING_DRAM
+//SDRAM shared by all the bus ports, in CPU cycles : fixed first word latency, one beat every DRAM_BEAT cycles,
+//one open row per bank with a DRAM_ROW_MISS penalty, and refresh blackouts which close all the rows
+class DramDevice{
+public:
+	uint32_t openRows[DRAM_BANKS];
+	uint64_t busFree = 0;
+	uint64_t refreshEpoch = 0;
+	uint64_t rowHits = 0, rowMisses = 0, refreshStalls = 0;
+
+	DramDevice(){
+		for(uint32_t bank = 0;bank < DRAM_BANKS;bank++) openRows[bank] = -1;
+	}
+
+	//Return the cycle at which the first beat of the access is on the data bus
+	uint64_t access(uint64_t now, uint32_t address, uint32_t beats){
+		uint64_t window = now % DRAM_REFRESH_INTERVAL;
+		if(window < DRAM_REFRESH_CYCLES){
+			now += DRAM_REFRESH_CYCLES - window;
+			refreshStalls++;
+		}
+		if(now / DRAM_REFRESH_INTERVAL != refreshEpoch){
+			refreshEpoch = now / DRAM_REFRESH_INTERVAL;
+			for(uint32_t bank = 0;bank < DRAM_BANKS;bank++) openRows[bank] = -1;
+		}
+
+		uint32_t bank = (address >> DRAM_BANK_SHIFT) % DRAM_BANKS;
+		uint32_t row = (address >> DRAM_BANK_SHIFT) / DRAM_BANKS;
+		uint64_t first = now + DRAM_LATENCY;
+		if(openRows[bank] == row){
+			rowHits++;
+		} else {
+			rowMisses++;
+			first += DRAM_ROW_MISS;
+			openRows[bank] = row;
+		}
+		first = max(first, busFree);
+		busFree = first + beats*DRAM_BEAT;
+		return first;
+	}
+};
+
+//Per port view of the DramDevice, read bursts are served in order. Writes are posted, their data beats are
+//accepted at the bus rate while the device is kept busy for the following accesses.
+class BusTimingDram : public BusTiming{
+public:
+	class Burst{
+	public:
+		uint64_t nextBeat;
+		uint32_t beats;
+	};
+
+	DramDevice *dram;
+	uint64_t *now;
+	queue<Burst> reads;
+	Burst write = {0, 0};
+
+	BusTimingDram(DramDevice *dram, uint64_t *now){
+		this->dram = dram;
+		this->now = now;
+	}
+
+	virtual bool cmdReady() { return write.beats == 0; }
+
+	virtual void cmd(uint32_t address, uint32_t beats, bool wr){
+		uint64_t first = dram->access(*now, address, beats);
+		if(wr){
+			write.nextBeat = *now + DRAM_BEAT;
+			write.beats = beats - 1;
+		} else {
+			Burst burst;
+			burst.nextBeat = first;
+			burst.beats = beats;
+			reads.push(burst);
+		}
+	}
+
+	virtual bool rspReady() { return reads.empty() || *now >= reads.front().nextBeat; }
+
+	virtual void rspFire(){
+		if(reads.empty()) return;
+		Burst &burst = reads.front();
+		burst.nextBeat += DRAM_BEAT;
+		if(--burst.beats == 0) reads.pop();
+	}
+
+	//Single beat write acknowledges aren't tracked and complete immediately
+	virtual bool writeReady() { return write.beats == 0 || *now >= write.nextBeat; }
+
+	virtual void writeFire(){
+		if(write.beats == 0) return;
+		write.nextBeat += DRAM_BEAT;
+		write.beats--;
+	}
+};
+#endif
+
+#ifdef L2
+//L2 shared by the iBus and dBus ports in front of their memory timing model. Reads which hit are served after
+//L2_HIT_LATENCY cycles at one beat per cycle. Each missing L2 line touched by a read is fetched as a whole line
+//burst from the memory, once all of them are received the read is served L2_MISS_LATENCY cycles later at one beat
+//per cycle. As the L1 data cache, it is write-through without write allocation.
+class BusTimingL2 : public BusTiming{
+public:
+	class Burst{
+	public:
+		uint64_t nextBeat;
+		uint32_t beats;
+		uint32_t fillBeats; //Memory beats of the line refills still to be received
+	};
+
+	BusTiming *memory;
+	CacheModel *cache;
+	uint64_t *now;
+	deque<Burst> reads;
+
+	BusTimingL2(BusTiming *memory, CacheModel *cache, uint64_t *now){
+		this->memory = memory;
+		this->cache = cache;
+		this->now = now;
+	}
+
+	virtual ~BusTimingL2(){
+		delete memory;
+	}
+
+	virtual bool cmdReady() { return memory->cmdReady(); }
+
+	virtual void cmd(uint32_t address, uint32_t beats, bool wr){
+		if(wr){
+			memory->cmd(address, beats, wr);
+			return;
+		}
+		Burst burst;
+		burst.beats = beats;
+		burst.fillBeats = 0;
+		uint32_t first = address & ~(L2_LINE-1), last = (address + beats*4 - 1) & ~(L2_LINE-1);
+		for(uint32_t line = first;;line += L2_LINE){
+			if(!cache->access(line)){
+				memory->cmd(line, L2_LINE/4, false);
+				burst.fillBeats += L2_LINE/4;
+			}
+			if(line == last) break;
+		}
+		burst.nextBeat = *now + L2_HIT_LATENCY;
+		reads.push_back(burst);
+	}
+
+	//Receive one refill beat per cycle from the memory, for the oldest read still waiting for its lines
+	virtual void tick(){
+		memory->tick();
+		for(Burst &burst : reads){
+			if(burst.fillBeats == 0) continue;
+			if(memory->rspReady()){
+				memory->rspFire();
+				if(--burst.fillBeats == 0) burst.nextBeat = *now + L2_MISS_LATENCY;
+			}
+			break;
+		}
+	}
+
+	virtual bool rspReady(){
+		if(reads.empty()) return true;
+		Burst &burst = reads.front();
+		return burst.fillBeats == 0 && *now >= burst.nextBeat;
+	}
+
+	virtual void rspFire(){
+		if(reads.empty()) return;
+		Burst &burst = reads.front();
+		burst.nextBeat++;
+		if(--burst.beats == 0) reads.pop_front();
+	}
+
+	virtual bool writeReady() { return memory->writeReady(); }
+	virtual void writeFire() { memory->writeFire(); }
+};
+#endif
+
+#ifdef BUS_PROFILE
+//Wrap the timing model of a bus port to collect statistics about the traffic it serves
+class BusProfiler : public BusTiming{
+public:
+	class Region{
+	public:
+		uint64_t readBeats = 0, writeBeats = 0;
+	};
+	class Pending{
+	public:
+		uint64_t cmdAt;
+		uint32_t beats;
+		bool first;
+	};
+
+	BusTiming *timing;
+	uint64_t *now;
+	uint64_t readCmds = 0, writeCmds = 0, readBeats = 0, writeBeats = 0;
+	uint64_t cmdNotReady = 0, rspNotReady = 0, writeNotReady = 0;
+	uint64_t latencies[65] = {0}; //Cycles between a read command and its first beat, by power of two
+	map<uint32_t, uint64_t> burstLengths;
+	map<uint32_t, Region> regions; //By 1 MB
+	queue<Pending> pendings;
+
+	BusProfiler(BusTiming *timing, uint64_t *now){
+		this->timing = timing;
+		this->now = now;
+	}
+
+	virtual ~BusProfiler(){
+		delete timing;
+	}
+
+	virtual void tick(){
+		timing->tick();
+	}
+
+	virtual bool cmdReady(){
+		return timing->cmdReady();
+	}
+
+	virtual void cmdStall(){
+		timing->cmdStall();
+		cmdNotReady++;
+	}
+
+	virtual void cmd(uint32_t address, uint32_t beats, bool wr){
+		timing->cmd(address, beats, wr);
+		burstLengths[beats]++;
+		Region &region = regions[address >> 20];
+		if(wr){
+			writeCmds++;
+			writeBeats += beats;
+			region.writeBeats += beats;
+		} else {
+			readCmds++;
+			readBeats += beats;
+			region.readBeats += beats;
+			Pending pending;
+			pending.cmdAt = *now;
+			pending.beats = beats;
+			pending.first = true;
+			pendings.push(pending);
+		}
+	}
+
+	virtual bool rspReady(){
+		bool ready = timing->rspReady();
+		if(!ready) rspNotReady++;
+		return ready;
+	}
+
+	virtual void rspFire(){
+		timing->rspFire();
+		if(pendings.empty()) return;
+		Pending &pending = pendings.front();
+		if(pending.first){
+			uint32_t bucket = 0;
+			while((*now - pending.cmdAt) >> bucket) bucket++;
+			latencies[bucket]++;
+			pending.first = false;
+		}
+		if(--pending.beats == 0) pendings.pop();
+	}
+
+	virtual bool writeReady(){
+		bool ready = timing->writeReady();
+		if(!ready) writeNotReady++;
+		return ready;
+	}
+
+	virtual void writeFire(){
+		timing->writeFire();
+	}
+
+	void dump(ostream &out, string port){
+		out << port << endl;
+		out << "  commands : read=" << readCmds << " write=" << writeCmds << endl;
+		out << "  bytes : read=" << readBeats*4 << " write=" << writeBeats*4 << endl;
+		out << "  back-pressure cycles : cmd=" << cmdNotReady << " rsp=" << rspNotReady << " write=" << writeNotReady << endl;
+		out << "  burst lengths (beats) :" << endl;
+		for(auto &e : burstLengths) out << "    " << setw(4) << e.first << " : " << e.second << endl;
+		out << "  read latencies (cycles) :" << endl;
+		for(uint32_t bucket = 0;bucket < 65;bucket++){
+			if(latencies[bucket] == 0) continue;
+			uint64_t low = bucket == 0 ? 0 : 1ull << (bucket-1);
+			out << "    " << setw(5) << low << "-" << setw(5) << left << (bucket == 0 ? 0 : (low << 1) - 1) << right << " : " << latencies[bucket] << endl;
+		}
+		out << "  regions (1 MB) :" << endl;
+		for(auto &e : regions){
+			uint64_t beats = e.second.readBeats + e.second.writeBeats;
+			out << "    0x" << hex << setw(8) << setfill('0') << (e.first << 20) << dec << setfill(' ') << " : read=" << e.second.readBeats*4 << " write=" << e.second.writeBeats*4;
+			out << " (" << fixed << setprecision(1) << 100.0*beats/max<uint64_t>(1, readBeats + writeBeats) << "%)" << endl;
+			out.unsetf(ios::fixed);
+		}
+	}
+};
+#endif
+
 class Workspace;
 
 class Workspace{
@@ -1081,6 +1634,7 @@ public:
 	static uint32_t testsCounter, successCounter;
 	static uint64_t cycles;
 	uint64_t instanceCycles = 0;
+	uint64_t instanceInstructions = 0;
 	vector<SimElement*> simElements;
 	Memory mem;
 	string name;
@@ -1094,7 +1648,21 @@ public:
 	double cyclesPerSecond = 10e6;
 	double allowedCycles = 0.0;
 	uint32_t bootPc = -1;
+	bool failed = false;
 	uint32_t iStall = STALL,dStall = STALL;
+	BusTiming *iTiming = NULL, *dTiming = NULL;
+	#ifdef TIMING_DRAM
+	DramDevice dram;
+	#endif
+	#ifdef L2
+	CacheModel l2 = CacheModel(L2_SIZE, L2_WAYS, L2_LINE, CacheModel::L2_REPLACEMENT);
+	#endif
+	#ifdef SHADOW_ICACHE
+	vector<ShadowCache*> iShadows = ShadowCache::parse(SHADOW_ICACHE);
+	#endif
+	#ifdef SHADOW_DCACHE
+	vector<ShadowCache*> dShadows = ShadowCache::parse(SHADOW_DCACHE);
+	#endif
 	#ifdef TRACE
 	VerilatedVcdC* tfp;
 	#endif
@@ -1104,6 +1672,27 @@ public:
 	Workspace* setIStall(bool enable) { iStall = enable; return this; }
 	Workspace* setDStall(bool enable) { dStall = enable; return this; }
 
+	//Timing model of the memory behind a bus port, stall disabled means zero wait state
+	BusTiming* newBusTiming(bool stall){
+		BusTiming *timing;
+		if(!stall){
+			timing = new BusTiming();
+		} else {
+			#ifdef TIMING_DRAM
+			timing = new BusTimingDram(&dram, &instanceCycles);
+			#else
+			timing = new BusTimingRandom();
+			#endif
+		}
+		#ifdef L2
+		timing = new BusTimingL2(timing, &l2, &instanceCycles);
+		#endif
+		#ifdef BUS_PROFILE
+		timing = new BusProfiler(timing, &instanceCycles);
+		#endif
+		return timing;
+	}
+
 	ofstream regTraces;
 	ofstream memTraces;
 	ofstream logTraces;
@@ -1141,6 +1730,30 @@ public:
 
 
 	    virtual bool isMmuRegion(uint32_t v) {return ws->isMmuRegion(v);}
+	    virtual void onTrap(bool interrupt, int32_t cause, uint32_t value, uint32_t fromPrivilege, uint32_t toPrivilege) {
+	        ws->onRefTrap(interrupt, cause, value, fromPrivilege, toPrivilege);
+	    }
+	    virtual void onMret(uint32_t toPrivilege) { ws->onRefMret(toPrivilege); }
+
+	    #ifdef UTIME_INPUT
+	    //The DUT sample its utime input some cycles before the golden model commit the instruction, so take the value it
+	    //read once checked against the mTime of the last UTIME_WINDOW cycles
+	    virtual bool csrRead(int32_t csr, uint32_t *value){
+	        if(csr == UTIME || csr == UTIMEH){
+	            *value = ws->top->VexRiscv->lastStageRegFileWrite_payload_data;
+	            if(!ws->top->VexRiscv->lastStageRegFileWrite_valid) return false;
+	            uint64_t oldest = ws->mTime > UTIME_WINDOW ? ws->mTime - UTIME_WINDOW : 0;
+	            bool inWindow = csr == UTIME ? (uint32_t)ws->mTime - *value <= (uint32_t)(ws->mTime - oldest)
+	                                         : *value == (ws->mTime >> 32) || *value == (oldest >> 32);
+	            if(!inWindow){
+	                cout << "UTIME " << (csr == UTIME ? "time" : "timeh") << " = 0x" << hex << *value << " out of the mTime window 0x" << oldest << " 0x" << ws->mTime << dec << endl;
+	                fail();
+	            }
+	            return false;
+	        }
+	        return RiscvGolden::csrRead(csr, value);
+	    }
+	    #endif
 
     	bool rfWriteValid;
     	int32_t rfWriteAddress;
@@ -1155,6 +1768,9 @@ public:
 
         virtual bool iRead(int32_t address, uint32_t *data){
         	bool error;
+        	#ifdef SHADOW_ICACHE
+        	for(ShadowCache *cache : ws->iShadows) cache->access(address, false);
+        	#endif
         	ws->iBusAccess(address, data, &error);
 //    		ws->iBusAccessPatch(address,data,&error);
     		return error;
@@ -1180,6 +1796,9 @@ public:
 				return t.error;
     		}else {
             	mem.read(address, size, (uint8_t*)data);
+            	#ifdef SHADOW_DCACHE
+            	for(ShadowCache *cache : ws->dShadows) cache->access(address, false);
+            	#endif
     		}
     		return false;
         }
@@ -1189,6 +1808,9 @@ public:
 
     		if(!ws->isPerifRegion(address)){
     			mem.write(address, size, (uint8_t*)&data);
+            	#ifdef SHADOW_DCACHE
+            	for(ShadowCache *cache : ws->dShadows) cache->access(address, true);
+            	#endif
     		}
     		if(ws->isDBusCheckedRegion(address)){
 				MemWrite w;
@@ -1260,6 +1882,14 @@ public:
 
 	virtual ~Workspace(){
 		delete top;
+		delete iTiming;
+		delete dTiming;
+		#ifdef SHADOW_ICACHE
+		for(ShadowCache *cache : iShadows) delete cache;
+		#endif
+		#ifdef SHADOW_DCACHE
+		for(ShadowCache *cache : dShadows) delete cache;
+		#endif
 		#ifdef TRACE
 		delete tfp;
 		#endif
@@ -1299,6 +1929,8 @@ public:
 
     virtual bool isPerifRegion(uint32_t addr) { return false; }
     virtual bool isMmuRegion(uint32_t addr) { return true;}
+    virtual void onRefTrap(bool interrupt, int32_t cause, uint32_t value, uint32_t fromPrivilege, uint32_t toPrivilege) {}
+    virtual void onRefMret(uint32_t toPrivilege) {}
     virtual void iBusAccess(uint32_t addr, uint32_t *data, bool *error) {
 		if(addr % 4 != 0) {
 			cout << "Warning, unaligned IBusAccess : " << addr << endl;
@@ -1420,6 +2052,8 @@ public:
 	Workspace* run(uint64_t timeout = 5000){
 //		cout << "Start " << name << endl;
 		if(timeout == 0) timeout = 0x7FFFFFFFFFFFFFFF;
+		iTiming = newBusTiming(iStall);
+		dTiming = newBusTiming(dStall);
 
 		currentTime = 4;
 		// init trace dump
@@ -1452,6 +2086,9 @@ public:
 		#ifdef SUPERVISOR
 		top->externalInterruptS = 0;
 		#endif
+		#ifdef UTIME_INPUT
+		top->utime = 0;
+		#endif
 		#ifdef DEBUG_PLUGIN_EXTERNAL
 		top->timerInterrupt = 0;
 		top->externalInterrupt = 0;
@@ -1489,7 +2126,6 @@ public:
 		}
 		#endif
 
-        bool failed = false;
 		try {
 			// run simulation for 100 clock periods
 			for (i = 16; i < timeout*2; i+=2) {
@@ -1516,6 +2152,9 @@ public:
 				top->timerInterrupt = mTime >= mTimeCmp ? 1 : 0;
 				//if(mTime == mTimeCmp) printf("SIM timer tick\n");
 				#endif
+				#ifdef UTIME_INPUT
+				top->utime = mTime;
+				#endif
 
 				currentTime = i;
 
@@ -1555,6 +2194,7 @@ public:
                     }
 				#endif
                 if(top->VexRiscv->lastStageIsFiring){
+                    instanceInstructions++;
                    	if(riscvRefEnable) {
 //                        privilegeCounters[riscvRef.privilege]++;
 //                        if((riscvRef.stepCounter & 0xFFFFF) == 0){
@@ -1607,6 +2247,8 @@ public:
                     }
                 }
 
+				iTiming->tick();
+				dTiming->tick();
 				for(SimElement* simElement : simElements) simElement->preCycle();
 
 				dump(i + 1);
@@ -1632,6 +2274,17 @@ public:
 			cout <<"SUCCESS " << name <<  endl;
 			successCounter++;
 			cycles += instanceCycles;
+			#ifdef TIMING_DRAM
+			cout << "DRAM " << name << " rowHits=" << dram.rowHits << " rowMisses=" << dram.rowMisses << " refreshStalls=" << dram.refreshStalls << endl;
+			#endif
+			#ifdef L2
+			cout << "L2 " << name << " hits=" << l2.hits << " misses=" << l2.misses << " hitRate=" << 100.0*l2.hits/max<uint64_t>(1, l2.hits + l2.misses) << "%";
+			cout << " occupancy=" << 100.0*l2.occupancy()/l2.lines.size() << "%" << endl;
+			#endif
+			#ifdef BENCH
+			logTraces.flush();
+			Bench::add(name, iStall, dStall, instanceCycles, instanceInstructions);
+			#endif
 			staticMutex.unlock();
 		} catch (const std::exception& e) {
 			staticMutex.lock();
@@ -1648,6 +2301,29 @@ public:
 
 
 
+		#if defined(SHADOW_ICACHE) || defined(SHADOW_DCACHE)
+		{
+			ofstream report((name + ".shadowCache").c_str());
+			#ifdef SHADOW_ICACHE
+			report << "I$" << endl;
+			for(ShadowCache *cache : iShadows) cache->report(report);
+			#endif
+			#ifdef SHADOW_DCACHE
+			report << "D$" << endl;
+			for(ShadowCache *cache : dShadows) cache->report(report);
+			#endif
+		}
+		#endif
+
+		#ifdef BUS_PROFILE
+		{
+			ofstream profile((name + ".busProfile").c_str());
+			profile << "cycles=" << instanceCycles << endl;
+			((BusProfiler*)iTiming)->dump(profile, "iBus");
+			((BusProfiler*)dTiming)->dump(profile, "dBus");
+		}
+		#endif
+
 		dump(i);
 		dump(i+10);
 		#ifdef TRACE
@@ -1791,15 +2467,121 @@ public:
 
 
 
+//Protocol agnostic transaction engine behind all the iBus/dBus memory models. The front-ends only translate their
+//handshakes into commands, write beats and response beats. Reads are sampled when their command is accepted, to keep
+//the ordering with the following writes, writes are applied beat by beat, and up to `outstanding` read bursts (or
+//acknowledged writes) are answered in order. The response beats are kept in a fixed ring, so every bus flavour has the
+//same per cycle cost.
+#define BUS_ENGINE_DEPTH 1024
+
+class BusEngine{
+public:
+	class Beat{
+	public:
+		uint32_t data;
+		bool error;
+		bool wr;
+		bool last;
+	};
+	Beat beats[BUS_ENGINE_DEPTH];
+	uint32_t rPtr = 0, wPtr = 0;
+	uint32_t pendings = 0, outstanding;
+	uint32_t writeAddress, writeSize, writeCount = 0;
+	bool iBus;
+	Workspace *ws;
+
+	BusEngine(Workspace *ws, bool iBus, uint32_t outstanding){
+		this->ws = ws;
+		this->iBus = iBus;
+		this->outstanding = outstanding;
+	}
+
+	BusTiming *timing() { return iBus ? ws->iTiming : ws->dTiming; }
+
+	void access(uint32_t address, bool wr, uint32_t size, uint32_t mask, uint32_t *data, bool *error){
+		if(iBus) ws->iBusAccess(address, data, error); else ws->dBusAccess(address, wr, size, mask, data, error);
+	}
+
+	void push(uint32_t data, bool error, bool wr, bool last){
+		assert(wPtr - rPtr < BUS_ENGINE_DEPTH);
+		Beat &beat = beats[wPtr++ % BUS_ENGINE_DEPTH];
+		beat.data = data;
+		beat.error = error;
+		beat.wr = wr;
+		beat.last = last;
+		if(last) pendings++;
+	}
+
+	//Can a new command be accepted this cycle, valid tells if the master has one waiting
+	bool cmdReady(bool valid){
+		bool ready = writeCount == 0 && timing()->cmdReady() && pendings < outstanding;
+		if(valid && !ready) timing()->cmdStall();
+		return ready;
+	}
+	//A write burst is waiting for its next data beats
+	bool writeBurst() { return writeCount != 0; }
+	bool writeBeatReady() { return timing()->writeReady(); }
+	//Some responses are still to be returned
+	bool pending() { return rPtr != wPtr; }
+
+	//Wrapping bursts stay in their beatCount*4 bytes aligned block, the others are linear
+	void read(uint32_t address, uint32_t beatCount, uint32_t size = 2, bool wrap = false){
+		uint32_t wrapMask = wrap ? beatCount*4-1 : ~0;
+		timing()->cmd(address, beatCount, false);
+		for(uint32_t beat = 0;beat < beatCount;beat++){
+			uint32_t data;
+			bool error;
+			access((address & ~wrapMask) | ((address + beat*4) & wrapMask), 0, size, 0xF, &data, &error);
+			push(data, error, false, beat == beatCount-1);
+		}
+	}
+
+	//The command come with its first data beat, the protocols which acknowledge their writes get a response beat
+	void write(uint32_t address, uint32_t beatCount, uint32_t size, uint32_t mask, uint32_t data, bool ack){
+		timing()->cmd(address, beatCount, true);
+		writeAddress = address;
+		writeSize = size;
+		writeCount = beatCount;
+		bool error = writeData(mask, data);
+		if(ack) push(VL_RANDOM_I(32), error, true, true);
+	}
+
+	void writeBeat(uint32_t mask, uint32_t data){
+		timing()->writeFire();
+		writeData(mask, data);
+	}
+
+	bool writeData(uint32_t mask, uint32_t data){
+		bool error;
+		access(writeAddress, 1, writeSize, mask, &data, &error);
+		writeAddress += 4;
+		writeCount--;
+		return error;
+	}
+
+	//Can the next response beat complete this cycle
+	bool rspValid(){
+		if(rPtr == wPtr) return false;
+		return beats[rPtr % BUS_ENGINE_DEPTH].wr ? timing()->writeReady() : timing()->rspReady();
+	}
+
+	Beat &rsp(){
+		Beat &beat = beats[rPtr++ % BUS_ENGINE_DEPTH];
+		if(beat.wr) timing()->writeFire(); else timing()->rspFire();
+		if(beat.last) pendings--;
+		return beat;
+	}
+};
+
+
 #ifdef IBUS_SIMPLE
 class IBusSimple : public SimElement{
 public:
-	uint32_t pendings[256];
-	uint32_t rPtr = 0, wPtr = 0;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	IBusSimple(Workspace* ws){
+	IBusSimple(Workspace* ws) : bus(ws, true, ~0){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -1812,27 +2594,22 @@ public:
 	virtual void preCycle(){
 		if (top->iBus_cmd_valid && top->iBus_cmd_ready) {
 			//assertEq(top->iBus_cmd_payload_pc & 3,0);
-			pendings[wPtr] = (top->iBus_cmd_payload_pc);
-			wPtr = (wPtr + 1) & 0xFF;
-			//ws->iBusAccess(top->iBus_cmd_payload_pc,&inst_next,&error_next);
+			bus.read(top->iBus_cmd_payload_pc, 1);
 		}
 	}
 	//TODO doesn't catch when instruction removed ?
 	virtual void postCycle(){
 		top->iBus_rsp_valid = 0;
-		if(rPtr != wPtr && (!ws->iStall || VL_RANDOM_I(7) < 100)){
-	        uint32_t inst_next;
-	        bool error_next;
-		    ws->iBusAccess(pendings[rPtr], &inst_next,&error_next);
-        	rPtr = (rPtr + 1) & 0xFF;
-			top->iBus_rsp_payload_inst = inst_next;
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
+			top->iBus_rsp_payload_inst = beat.data;
 			top->iBus_rsp_valid = 1;
-			top->iBus_rsp_payload_error = error_next;
+			top->iBus_rsp_payload_error = beat.error;
 		} else {
 		    top->iBus_rsp_payload_inst = VL_RANDOM_I(32);
 		    top->iBus_rsp_payload_error = VL_RANDOM_I(1);
 		}
-		if(ws->iStall) top->iBus_cmd_ready = VL_RANDOM_I(7) < 100;
+		top->iBus_cmd_ready = bus.cmdReady(top->iBus_cmd_valid);
 	}
 };
 #endif
@@ -1874,21 +2651,15 @@ public:
 #endif
 
 
-#ifdef IBUS_SIMPLE_AVALON
-
-struct IBusSimpleAvalonRsp{
-	uint32_t data;
-	bool error;
-};
-
 
+#ifdef IBUS_SIMPLE_AVALON
 class IBusSimpleAvalon : public SimElement{
 public:
-	queue<IBusSimpleAvalonRsp> rsps;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	IBusSimpleAvalon(Workspace* ws){
+	IBusSimpleAvalon(Workspace* ws) : bus(ws, true, ~0){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -1900,25 +2671,22 @@ public:
 
 	virtual void preCycle(){
 		if (top->iBusAvalon_read && top->iBusAvalon_waitRequestn) {
-			IBusSimpleAvalonRsp rsp;
-			ws->iBusAccess(top->iBusAvalon_address,&rsp.data,&rsp.error);
-			rsps.push(rsp);
+			bus.read(top->iBusAvalon_address, 1);
 		}
 	}
 	//TODO doesn't catch when instruction removed ?
 	virtual void postCycle(){
-		if(!rsps.empty() && (!ws->iStall || VL_RANDOM_I(7) < 100)){
-			IBusSimpleAvalonRsp rsp = rsps.front(); rsps.pop();
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
 			top->iBusAvalon_readDataValid = 1;
-			top->iBusAvalon_readData = rsp.data;
-			top->iBusAvalon_response = rsp.error ? 3 : 0;
+			top->iBusAvalon_readData = beat.data;
+			top->iBusAvalon_response = beat.error ? 3 : 0;
 		} else {
 			top->iBusAvalon_readDataValid = 0;
 			top->iBusAvalon_readData = VL_RANDOM_I(32);
 			top->iBusAvalon_response = VL_RANDOM_I(2);
 		}
-		if(ws->iStall)
-			top->iBusAvalon_waitRequestn = VL_RANDOM_I(7) < 100;
+		top->iBusAvalon_waitRequestn = bus.cmdReady(top->iBusAvalon_read);
 	}
 };
 #endif
@@ -1928,39 +2696,35 @@ public:
 #ifdef IBUS_SIMPLE_AHBLITE3
 class IBusSimpleAhbLite3 : public SimElement{
 public:
+	BusEngine bus;
+
 	Workspace *ws;
 	VVexRiscv* top;
 
-	uint32_t iBusAhbLite3_HRDATA;
-	bool iBusAhbLite3_HRESP;
-	bool pending;
-
-	IBusSimpleAhbLite3(Workspace* ws){
+	IBusSimpleAhbLite3(Workspace* ws) : bus(ws, true, 1){
 		this->ws = ws;
 		this->top = ws->top;
 	}
 
 	virtual void onReset(){
-	    pending = false;
 		top->iBusAhbLite3_HREADY = 1;
 		top->iBusAhbLite3_HRESP = 0;
 	}
 
 	virtual void preCycle(){
         if (top->iBusAhbLite3_HTRANS == 2 && top->iBusAhbLite3_HREADY && !top->iBusAhbLite3_HWRITE) {
-            ws->iBusAccess(top->iBusAhbLite3_HADDR,&iBusAhbLite3_HRDATA,&iBusAhbLite3_HRESP);
-            pending = true;
+            bus.read(top->iBusAhbLite3_HADDR, 1);
         }
 	}
 
 	virtual void postCycle(){
-		if(ws->iStall)
-			top->iBusAhbLite3_HREADY = (!ws->iStall || VL_RANDOM_I(7) < 100);
+		bool pending = bus.pending();
+		top->iBusAhbLite3_HREADY = pending ? bus.rspValid() : bus.cmdReady(top->iBusAhbLite3_HTRANS == 2);
 
 		if(pending && top->iBusAhbLite3_HREADY){
-			top->iBusAhbLite3_HRDATA = iBusAhbLite3_HRDATA;
-			top->iBusAhbLite3_HRESP  = iBusAhbLite3_HRESP;
-			pending = false;
+			BusEngine::Beat &beat = bus.rsp();
+			top->iBusAhbLite3_HRDATA = beat.data;
+			top->iBusAhbLite3_HRESP  = beat.error;
 		} else {
 			top->iBusAhbLite3_HRDATA = VL_RANDOM_I(32);
 			top->iBusAhbLite3_HRESP = VL_RANDOM_I(1);
@@ -1973,13 +2737,11 @@ public:
 #ifdef IBUS_CACHED
 class IBusCached : public SimElement{
 public:
-	bool error_next = false;
-	uint32_t pendingCount = 0;
-	uint32_t address;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	IBusCached(Workspace* ws){
+	IBusCached(Workspace* ws) : bus(ws, true, BUS_OUTSTANDING){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -1991,52 +2753,40 @@ public:
 	}
 
 	virtual void preCycle(){
-		if (top->iBus_cmd_valid && top->iBus_cmd_ready && pendingCount == 0) {
+		if (top->iBus_cmd_valid && top->iBus_cmd_ready) {
 			assertEq(top->iBus_cmd_payload_address & 3,0);
-			pendingCount = (1 << top->iBus_cmd_payload_size)/4;
-			address = top->iBus_cmd_payload_address;
-		}
-	}
-
-	virtual void postCycle(){
-		bool error;
-		top->iBus_rsp_valid = 0;
-		if(pendingCount != 0 && (!ws->iStall || VL_RANDOM_I(7) < 100)){
 		    #ifdef IBUS_TC
-            if((address & 0x70000000) == 0){
+            if((top->iBus_cmd_payload_address & 0x70000000) == 0){
                 printf("IBUS_CACHED access out of range\n");
                 ws->fail();
             }
             #endif
-			ws->iBusAccess(address,&top->iBus_rsp_payload_data,&error);
-			top->iBus_rsp_payload_error = error;
-			pendingCount--;
-			address = address + 4;
+			bus.read(top->iBus_cmd_payload_address, (1 << top->iBus_cmd_payload_size)/4);
+		}
+	}
+
+	virtual void postCycle(){
+		top->iBus_rsp_valid = 0;
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
+			top->iBus_rsp_payload_data = beat.data;
+			top->iBus_rsp_payload_error = beat.error;
 			top->iBus_rsp_valid = 1;
 		}
-		if(ws->iStall) top->iBus_cmd_ready = VL_RANDOM_I(7) < 100 && pendingCount == 0;
+		top->iBus_cmd_ready = bus.cmdReady(top->iBus_cmd_valid);
 	}
 };
 #endif
 
 #ifdef IBUS_CACHED_AVALON
-#include <queue>
-
-struct IBusCachedAvalonTask{
-	uint32_t address;
-	uint32_t pendingCount;
-};
-
 class IBusCachedAvalon : public SimElement{
 public:
-	uint32_t inst_next = VL_RANDOM_I(32);
-	bool error_next = false;
+	BusEngine bus;
 
-	queue<IBusCachedAvalonTask> tasks;
 	Workspace *ws;
 	VVexRiscv* top;
 
-	IBusCachedAvalon(Workspace* ws){
+	IBusCachedAvalon(Workspace* ws) : bus(ws, true, BUS_OUTSTANDING){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2049,51 +2799,40 @@ public:
 	virtual void preCycle(){
 		if (top->iBusAvalon_read && top->iBusAvalon_waitRequestn) {
 			assertEq(top->iBusAvalon_address & 3,0);
-			IBusCachedAvalonTask task;
-			task.address = top->iBusAvalon_address;
-			task.pendingCount = top->iBusAvalon_burstCount;
-			tasks.push(task);
+			bus.read(top->iBusAvalon_address, top->iBusAvalon_burstCount, 2, true);
 		}
 	}
 
 	virtual void postCycle(){
-		bool error;
 		top->iBusAvalon_readDataValid = 0;
-		if(!tasks.empty() && (!ws->iStall || VL_RANDOM_I(7) < 100)){
-			uint32_t &address = tasks.front().address;
-			uint32_t &pendingCount = tasks.front().pendingCount;
-			bool error;
-			ws->iBusAccess(address,&top->iBusAvalon_readData,&error);
-			top->iBusAvalon_response = error ? 3 : 0;
-			pendingCount--;
-			address = (address & ~0x1F) + ((address + 4) & 0x1F);
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
+			top->iBusAvalon_readData = beat.data;
+			top->iBusAvalon_response = beat.error ? 3 : 0;
 			top->iBusAvalon_readDataValid = 1;
-			if(pendingCount == 0)
-				tasks.pop();
 		}
-		if(ws->iStall)
-			top->iBusAvalon_waitRequestn = VL_RANDOM_I(7) < 100;
+		top->iBusAvalon_waitRequestn = bus.cmdReady(top->iBusAvalon_read);
 	}
 };
 #endif
 
 
 #if defined(IBUS_CACHED_WISHBONE) || defined(IBUS_SIMPLE_WISHBONE)
-#include <queue>
-
 class IBusCachedWishbone : public SimElement{
 public:
+	BusEngine bus;
+	bool started = false;
 
 	Workspace *ws;
 	VVexRiscv* top;
 
-	IBusCachedWishbone(Workspace* ws){
+	IBusCachedWishbone(Workspace* ws) : bus(ws, true, 1){
 		this->ws = ws;
 		this->top = ws->top;
 	}
 
 	virtual void onReset(){
-		top->iBusWishbone_ACK = !ws->iStall;
+		top->iBusWishbone_ACK = 0;
 		top->iBusWishbone_ERR = 0;
 	}
 
@@ -2102,19 +2841,18 @@ public:
 	}
 
 	virtual void postCycle(){
-
-		if(ws->iStall)
-			top->iBusWishbone_ACK = VL_RANDOM_I(7) < 100;
+		if(top->iBusWishbone_CYC && top->iBusWishbone_STB && !started){
+			bus.read(top->iBusWishbone_ADR << 2, 1);
+			started = true;
+		}
+		top->iBusWishbone_ACK = started && bus.rspValid();
 
         top->iBusWishbone_DAT_MISO = VL_RANDOM_I(32);
         if (top->iBusWishbone_CYC && top->iBusWishbone_STB && top->iBusWishbone_ACK) {
-            if(top->iBusWishbone_WE){
-
-            } else {
-                bool error;
-                ws->iBusAccess(top->iBusWishbone_ADR << 2,&top->iBusWishbone_DAT_MISO,&error);
-                top->iBusWishbone_ERR = error;
-            }
+            BusEngine::Beat &beat = bus.rsp();
+            started = false;
+            top->iBusWishbone_DAT_MISO = beat.data;
+            top->iBusWishbone_ERR = beat.error;
         }
 	}
 };
@@ -2124,13 +2862,11 @@ public:
 #ifdef DBUS_SIMPLE
 class DBusSimple : public SimElement{
 public:
-	uint32_t data_next = VL_RANDOM_I(32);
-	bool error_next = false;
-	bool pending = false;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	DBusSimple(Workspace* ws){
+	DBusSimple(Workspace* ws) : bus(ws, false, 1){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2142,43 +2878,37 @@ public:
 
 	virtual void preCycle(){
 		if (top->dBus_cmd_valid && top->dBus_cmd_ready) {
-			pending = true;
-			data_next = top->dBus_cmd_payload_data;
-			ws->dBusAccess(top->dBus_cmd_payload_address,top->dBus_cmd_payload_wr,top->dBus_cmd_payload_size,0xF,&data_next,&error_next);
+			if(top->dBus_cmd_payload_wr)
+				bus.write(top->dBus_cmd_payload_address, 1, top->dBus_cmd_payload_size, 0xF, top->dBus_cmd_payload_data, true);
+			else
+				bus.read(top->dBus_cmd_payload_address, 1, top->dBus_cmd_payload_size);
 		}
 	}
 
 	virtual void postCycle(){
 		top->dBus_rsp_ready = 0;
-		if(pending && (!ws->dStall || VL_RANDOM_I(7) < 100)){
-			pending = false;
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
 			top->dBus_rsp_ready = 1;
-			top->dBus_rsp_data = data_next;
-			top->dBus_rsp_error = error_next;
+			top->dBus_rsp_data = beat.data;
+			top->dBus_rsp_error = beat.error;
 		} else{
 			top->dBus_rsp_data = VL_RANDOM_I(32);
 		}
 
-		if(ws->dStall) top->dBus_cmd_ready = VL_RANDOM_I(7) < 100 && !pending;
+		top->dBus_cmd_ready = bus.cmdReady(top->dBus_cmd_valid);
 	}
 };
 #endif
 
 #ifdef DBUS_SIMPLE_AVALON
-#include <queue>
-struct DBusSimpleAvalonRsp{
-	uint32_t data;
-	bool error;
-};
-
-
 class DBusSimpleAvalon : public SimElement{
 public:
-	queue<DBusSimpleAvalonRsp> rsps;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	DBusSimpleAvalon(Workspace* ws){
+	DBusSimpleAvalon(Workspace* ws) : bus(ws, false, ~0){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2190,29 +2920,25 @@ public:
 
 	virtual void preCycle(){
 		if (top->dBusAvalon_write && top->dBusAvalon_waitRequestn) {
-			bool dummy;
-			ws->dBusAccess(top->dBusAvalon_address,1,2,top->dBusAvalon_byteEnable,&top->dBusAvalon_writeData,&dummy);
+			bus.write(top->dBusAvalon_address, 1, 2, top->dBusAvalon_byteEnable, top->dBusAvalon_writeData, false);
 		}
 		if (top->dBusAvalon_read && top->dBusAvalon_waitRequestn) {
-			DBusSimpleAvalonRsp rsp;
-			ws->dBusAccess(top->dBusAvalon_address,0,2,0xF,&rsp.data,&rsp.error);
-			rsps.push(rsp);
+			bus.read(top->dBusAvalon_address, 1);
 		}
 	}
 	//TODO doesn't catch when instruction removed ?
 	virtual void postCycle(){
-		if(!rsps.empty() && (!ws->iStall || VL_RANDOM_I(7) < 100)){
-			DBusSimpleAvalonRsp rsp = rsps.front(); rsps.pop();
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
 			top->dBusAvalon_readDataValid = 1;
-			top->dBusAvalon_readData = rsp.data;
-			top->dBusAvalon_response = rsp.error ? 3 : 0;
+			top->dBusAvalon_readData = beat.data;
+			top->dBusAvalon_response = beat.error ? 3 : 0;
 		} else {
 			top->dBusAvalon_readDataValid = 0;
 			top->dBusAvalon_readData = VL_RANDOM_I(32);
 			top->dBusAvalon_response = VL_RANDOM_I(2);
 		}
-		if(ws->iStall)
-			top->dBusAvalon_waitRequestn = VL_RANDOM_I(7) < 100;
+		top->dBusAvalon_waitRequestn = bus.cmdReady(top->dBusAvalon_read || top->dBusAvalon_write);
 	}
 };
 #endif
@@ -2220,14 +2946,18 @@ public:
 
 
 #ifdef DBUS_SIMPLE_AHBLITE3
+//The write data come one cycle after the address phase, the engine get the write once HWDATA is available
 class DBusSimpleAhbLite3 : public SimElement{
 public:
+	BusEngine bus;
+
 	Workspace *ws;
 	VVexRiscv* top;
 
     uint32_t dBusAhbLite3_HADDR, dBusAhbLite3_HSIZE, dBusAhbLite3_HTRANS, dBusAhbLite3_HWRITE;
+    bool writePending = false;
 
-	DBusSimpleAhbLite3(Workspace* ws){
+	DBusSimpleAhbLite3(Workspace* ws) : bus(ws, false, 1){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2239,32 +2969,35 @@ public:
 	}
 
 	virtual void preCycle(){
-        if(top->dBusAhbLite3_HREADY && dBusAhbLite3_HTRANS == 2 && dBusAhbLite3_HWRITE){
-            uint32_t data = top->dBusAhbLite3_HWDATA;
-            bool error;
-            ws->dBusAccess(dBusAhbLite3_HADDR, 1, dBusAhbLite3_HSIZE, ((1 << (1 << dBusAhbLite3_HSIZE))-1) << (dBusAhbLite3_HADDR & 0x3),&data,&error);
-        }
-
         if(top->dBusAhbLite3_HREADY){
 	        dBusAhbLite3_HADDR = top->dBusAhbLite3_HADDR ;
 	        dBusAhbLite3_HSIZE = top->dBusAhbLite3_HSIZE ;
 	        dBusAhbLite3_HTRANS = top->dBusAhbLite3_HTRANS ;
 	        dBusAhbLite3_HWRITE = top->dBusAhbLite3_HWRITE ;
+	        if(dBusAhbLite3_HTRANS == 2){
+	        	if(dBusAhbLite3_HWRITE) writePending = true; else bus.read(dBusAhbLite3_HADDR, 1, dBusAhbLite3_HSIZE);
+	        }
         }
 	}
 
 	virtual void postCycle(){
-		if(ws->iStall)
-			top->dBusAhbLite3_HREADY = (!ws->iStall || VL_RANDOM_I(7) < 100);
+		if(writePending){
+			uint32_t mask = ((1 << (1 << dBusAhbLite3_HSIZE))-1) << (dBusAhbLite3_HADDR & 0x3);
+			bus.write(dBusAhbLite3_HADDR, 1, dBusAhbLite3_HSIZE, mask, top->dBusAhbLite3_HWDATA, true);
+			writePending = false;
+		}
 
+		bool pending = bus.pending();
+		top->dBusAhbLite3_HREADY = pending ? bus.rspValid() : bus.cmdReady(top->dBusAhbLite3_HTRANS == 2);
         top->dBusAhbLite3_HRDATA = VL_RANDOM_I(32);
         top->dBusAhbLite3_HRESP = VL_RANDOM_I(1);
 
-		if(top->dBusAhbLite3_HREADY && dBusAhbLite3_HTRANS == 2 && !dBusAhbLite3_HWRITE){
-
-		    bool error;
-		    ws->dBusAccess(dBusAhbLite3_HADDR, 0, dBusAhbLite3_HSIZE, ((1 << (1 << dBusAhbLite3_HSIZE))-1) << (dBusAhbLite3_HADDR & 0x3),&top->dBusAhbLite3_HRDATA,&error);
-            top->dBusAhbLite3_HRESP  = error;
+		if(pending && top->dBusAhbLite3_HREADY){
+			BusEngine::Beat &beat = bus.rsp();
+			if(!beat.wr){
+				top->dBusAhbLite3_HRDATA = beat.data;
+				top->dBusAhbLite3_HRESP  = beat.error;
+			}
 		}
 	}
 };
@@ -2272,22 +3005,21 @@ public:
 
 
 #if defined(DBUS_CACHED_WISHBONE) || defined(DBUS_SIMPLE_WISHBONE)
-#include <queue>
-
-
 class DBusCachedWishbone : public SimElement{
 public:
+	BusEngine bus;
+	bool started = false;
 
 	Workspace *ws;
 	VVexRiscv* top;
 
-	DBusCachedWishbone(Workspace* ws){
+	DBusCachedWishbone(Workspace* ws) : bus(ws, false, 1){
 		this->ws = ws;
 		this->top = ws->top;
 	}
 
 	virtual void onReset(){
-		top->dBusWishbone_ACK = !ws->iStall;
+		top->dBusWishbone_ACK = 0;
 		top->dBusWishbone_ERR = 0;
 	}
 
@@ -2296,17 +3028,21 @@ public:
 	}
 
 	virtual void postCycle(){
-		if(ws->iStall)
-			top->dBusWishbone_ACK = VL_RANDOM_I(7) < 100;
+		if(top->dBusWishbone_CYC && top->dBusWishbone_STB && !started){
+			if(top->dBusWishbone_WE)
+				bus.write(top->dBusWishbone_ADR << 2, 1, 2, top->dBusWishbone_SEL, top->dBusWishbone_DAT_MOSI, true);
+			else
+				bus.read(top->dBusWishbone_ADR << 2, 1);
+			started = true;
+		}
+		top->dBusWishbone_ACK = started && bus.rspValid();
         top->dBusWishbone_DAT_MISO = VL_RANDOM_I(32);
         if (top->dBusWishbone_CYC && top->dBusWishbone_STB && top->dBusWishbone_ACK) {
-            if(top->dBusWishbone_WE){
-                bool dummy;
-                ws->dBusAccess(top->dBusWishbone_ADR << 2 ,1,2,top->dBusWishbone_SEL,&top->dBusWishbone_DAT_MOSI,&dummy);
-            } else {
-                bool error;
-                ws->dBusAccess(top->dBusWishbone_ADR << 2,0,2,0xF,&top->dBusWishbone_DAT_MISO,&error);
-                top->dBusWishbone_ERR = error;
+            BusEngine::Beat &beat = bus.rsp();
+            started = false;
+            if(!beat.wr){
+                top->dBusWishbone_DAT_MISO = beat.data;
+                top->dBusWishbone_ERR = beat.error;
             }
         }
 	}
@@ -2319,14 +3055,11 @@ public:
 
 class DBusCached : public SimElement{
 public:
-	uint32_t address;
-	bool error_next = false;
-	uint32_t pendingCount = 0;
-	bool wr;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	DBusCached(Workspace* ws){
+	DBusCached(Workspace* ws) : bus(ws, false, BUS_OUTSTANDING){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2337,71 +3070,41 @@ public:
 	}
 
 	virtual void preCycle(){
-	    VL_IN8(io_cpu_execute_isValid,0,0);
-	    VL_IN8(io_cpu_execute_isStuck,0,0);
-	    VL_IN8(io_cpu_execute_args_kind,0,0);
-	    VL_IN8(io_cpu_execute_args_wr,0,0);
-	    VL_IN8(io_cpu_execute_args_size,1,0);
-	    VL_IN8(io_cpu_execute_args_forceUncachedAccess,0,0);
-	    VL_IN8(io_cpu_execute_args_clean,0,0);
-	    VL_IN8(io_cpu_execute_args_invalidate,0,0);
-	    VL_IN8(io_cpu_execute_args_way,0,0);
-
-//		if(top->VexRiscv->dataCache_1->io_cpu_execute_isValid && !top->VexRiscv->dataCache_1->io_cpu_execute_isStuck
-//				&& top->VexRiscv->dataCache_1->io_cpu_execute_args_wr){
-//			if(top->VexRiscv->dataCache_1->io_cpu_execute_args_address == 0x80025978)
-//				cout << "WR 0x80025978 = " << hex << setw(8) << top->VexRiscv->dataCache_1->io_cpu_execute_args_data << endl;
-//			if(top->VexRiscv->dataCache_1->io_cpu_execute_args_address == 0x8002596c)
-//				cout << "WR 0x8002596c = " << hex << setw(8) << top->VexRiscv->dataCache_1->io_cpu_execute_args_data << endl;
-//		}
 		if (top->dBus_cmd_valid && top->dBus_cmd_ready) {
-			if(pendingCount == 0){
-				pendingCount = top->dBus_cmd_payload_length+1;
-				address = top->dBus_cmd_payload_address;
-				wr = top->dBus_cmd_payload_wr;
-			}
-			if(top->dBus_cmd_payload_wr){
-				ws->dBusAccess(address,top->dBus_cmd_payload_wr,2,top->dBus_cmd_payload_mask,&top->dBus_cmd_payload_data,&error_next);
-				address += 4;
-				pendingCount--;
-			}
+			if(bus.writeBurst())
+				bus.writeBeat(top->dBus_cmd_payload_mask, top->dBus_cmd_payload_data);
+			else if(top->dBus_cmd_payload_wr)
+				bus.write(top->dBus_cmd_payload_address, top->dBus_cmd_payload_length+1, 2, top->dBus_cmd_payload_mask, top->dBus_cmd_payload_data, false);
+			else
+				bus.read(top->dBus_cmd_payload_address, top->dBus_cmd_payload_length+1);
 		}
 	}
 
 	virtual void postCycle(){
-		if(pendingCount != 0 && !wr && (!ws->dStall || VL_RANDOM_I(7) < 100)){
-			ws->dBusAccess(address,0,2,0,&top->dBus_rsp_payload_data,&error_next);
-			top->dBus_rsp_payload_error = error_next;
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
+			top->dBus_rsp_payload_data = beat.data;
+			top->dBus_rsp_payload_error = beat.error;
 			top->dBus_rsp_valid = 1;
-			address += 4;
-			pendingCount--;
 		} else{
 			top->dBus_rsp_valid = 0;
 			top->dBus_rsp_payload_data = VL_RANDOM_I(32);
 			top->dBus_rsp_payload_error = VL_RANDOM_I(1);
 		}
 
-		top->dBus_cmd_ready = (ws->dStall ? VL_RANDOM_I(7) < 100 : 1) && (pendingCount == 0 || wr);
+		top->dBus_cmd_ready = bus.writeBurst() ? bus.writeBeatReady() : bus.cmdReady(top->dBus_cmd_valid);
 	}
 };
 #endif
 
 #ifdef DBUS_CACHED_AVALON
-#include <queue>
-
-struct DBusCachedAvalonTask{
-	uint32_t data;
-	bool error;
-};
-
 class DBusCachedAvalon : public SimElement{
 public:
-	uint32_t beatCounter = 0;
-	queue<DBusCachedAvalonTask> rsps;
+	BusEngine bus;
 
 	Workspace *ws;
 	VVexRiscv* top;
-	DBusCachedAvalon(Workspace* ws){
+	DBusCachedAvalon(Workspace* ws) : bus(ws, false, BUS_OUTSTANDING){
 		this->ws = ws;
 		this->top = ws->top;
 	}
@@ -2414,29 +3117,20 @@ public:
 
 	virtual void preCycle(){
 		if ((top->dBusAvalon_read || top->dBusAvalon_write) && top->dBusAvalon_waitRequestn) {
-			if(top->dBusAvalon_write){
-				bool error_next = false;
-				ws->dBusAccess(top->dBusAvalon_address + beatCounter * 4,1,2,top->dBusAvalon_byteEnable,&top->dBusAvalon_writeData,&error_next);
-				beatCounter++;
-				if(beatCounter == top->dBusAvalon_burstCount){
-					beatCounter = 0;
-				}
-			} else {
-				for(int beat = 0;beat < top->dBusAvalon_burstCount;beat++){
-					DBusCachedAvalonTask rsp;
-					ws->dBusAccess(top->dBusAvalon_address  + beat * 4,0,2,0,&rsp.data,&rsp.error);
-					rsps.push(rsp);
-				}
-			}
+			if(bus.writeBurst())
+				bus.writeBeat(top->dBusAvalon_byteEnable, top->dBusAvalon_writeData);
+			else if(top->dBusAvalon_write)
+				bus.write(top->dBusAvalon_address, top->dBusAvalon_burstCount, 2, top->dBusAvalon_byteEnable, top->dBusAvalon_writeData, false);
+			else
+				bus.read(top->dBusAvalon_address, top->dBusAvalon_burstCount);
 		}
 	}
 
 	virtual void postCycle(){
-		if(!rsps.empty() && (!ws->dStall || VL_RANDOM_I(7) < 100)){
-			DBusCachedAvalonTask rsp = rsps.front();
-			rsps.pop();
-			top->dBusAvalon_response = rsp.error ? 3 : 0;
-			top->dBusAvalon_readData = rsp.data;
+		if(bus.rspValid()){
+			BusEngine::Beat &beat = bus.rsp();
+			top->dBusAvalon_response = beat.error ? 3 : 0;
+			top->dBusAvalon_readData = beat.data;
 			top->dBusAvalon_readDataValid = 1;
 		} else{
 			top->dBusAvalon_readDataValid = 0;
@@ -2444,37 +3138,27 @@ public:
 			top->dBusAvalon_response = VL_RANDOM_I(2); //TODO
 		}
 
-		top->dBusAvalon_waitRequestn = (ws->dStall ? VL_RANDOM_I(7) < 100 : 1);
+		top->dBusAvalon_waitRequestn = bus.writeBurst() ? bus.writeBeatReady() : bus.cmdReady(top->dBusAvalon_read || top->dBusAvalon_write);
 	}
 };
 #endif
 
 
 #ifdef DEBUG_PLUGIN
-#include <stdio.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <string.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <netinet/tcp.h>
+#include "../common/tcp_server.h"
 
-/** Returns true on success, or false if there was an error */
-bool SetSocketBlockingEnabled(int fd, bool blocking)
-{
-   if (fd < 0) return false;
+#define RISCV_SPINAL_FLAGS_RESET 1<<0
+#define RISCV_SPINAL_FLAGS_HALT 1<<1
+#define RISCV_SPINAL_FLAGS_PIP_BUSY 1<<2
+#define RISCV_SPINAL_FLAGS_IS_IN_BREAKPOINT 1<<3
+#define RISCV_SPINAL_FLAGS_STEP 1<<4
+#define RISCV_SPINAL_FLAGS_PC_INC 1<<5
 
-#ifdef WIN32
-   unsigned long mode = blocking ? 0 : 1;
-   return (ioctlsocket(fd, FIONBIO, &mode) == 0) ? true : false;
-#else
-   int flags = fcntl(fd, F_GETFL, 0);
-   if (flags < 0) return false;
-   flags = blocking ? (flags&~O_NONBLOCK) : (flags|O_NONBLOCK);
-   return (fcntl(fd, F_SETFL, flags) == 0) ? true : false;
-#endif
-}
+#define RISCV_SPINAL_FLAGS_RESET_SET 1<<16
+#define RISCV_SPINAL_FLAGS_HALT_SET 1<<17
+
+#define RISCV_SPINAL_FLAGS_RESET_CLEAR 1<<24
+#define RISCV_SPINAL_FLAGS_HALT_CLEAR 1<<25
 
 struct DebugPluginTask{
 	bool wr;
@@ -2482,22 +3166,26 @@ struct DebugPluginTask{
 	uint32_t data;
 };
 
+//The client can send many 10 bytes commands (wr, size, address, data) in a single packet. They are executed back to
+//back, and the 4 bytes responses of the reads are sent together once all the received commands are done. Sending one
+//command at the time and waiting its response, as the OpenOCD driver does, still works.
 class DebugPlugin : public SimElement{
 public:
 	Workspace *ws;
 	VVexRiscv* top;
 
-	int serverSocket, clientHandle;
-	struct sockaddr_in serverAddr;
-	struct sockaddr_storage serverStorage;
-	socklen_t addr_size;
-	char buffer[1024];
-	uint32_t timeSpacer = 0;
+	TcpServer server;
+	bool connected = false;
+	char buffer[4096];
+	uint32_t bufferSize = 0;
 	bool taskValid = false;
+	bool rspFire = false;
 	DebugPluginTask task;
+	queue<DebugPluginTask> tasks;
+	vector<uint32_t> rsps;
 
 
-	DebugPlugin(Workspace* ws){
+	DebugPlugin(Workspace* ws, uint16_t port = 7893) : server(port){
 		this->ws = ws;
 		this->top = ws->top;
 
@@ -2505,53 +3193,6 @@ public:
 			ws->mTimeCmp = ~0;
 		#endif
 		top->debugReset = 0;
-
-
-
-		//---- Create the socket. The three arguments are: ----//
-		// 1) Internet domain 2) Stream socket 3) Default protocol (TCP in this case) //
-		serverSocket = socket(PF_INET, SOCK_STREAM, 0);
-		assert(serverSocket != -1);
-		SetSocketBlockingEnabled(serverSocket,0);
-		int flag = 1;
-		int result = setsockopt(serverSocket,            /* socket affected */
-								 IPPROTO_TCP,     /* set option at TCP level */
-								 TCP_NODELAY,     /* name of option */
-								 (char *) &flag,  /* the cast is historical
-														 cruft */
-								 sizeof(int));    /* length of option value */
-
-		//---- Configure settings of the server address struct ----//
-		// Address family = Internet //
-		serverAddr.sin_family = AF_INET;
-		// Set port number, using htons function to use proper byte order //
-		serverAddr.sin_port = htons(7893);
-		// Set IP address to localhost //
-		serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
-		// Set all bits of the padding field to 0 //
-		memset(serverAddr.sin_zero, '\0', sizeof serverAddr.sin_zero);
-
-		//---- Bind the address struct to the socket ----//
-		bind(serverSocket, (struct sockaddr *) &serverAddr, sizeof(serverAddr));
-
-		//---- Listen on the socket, with 5 max connection requests queued ----//
-		listen(serverSocket,1);
-
-		//---- Accept call creates a new socket for the incoming connection ----//
-		addr_size = sizeof serverStorage;
-
-		clientHandle = -1;
-	}
-
-	virtual ~DebugPlugin(){
-		if(clientHandle != -1) {
-			shutdown(clientHandle,SHUT_RDWR);
-			usleep(100);
-		}
-		if(serverSocket != -1) {
-			close(serverSocket);
-			usleep(100);
-		}
 	}
 
 	virtual void onReset(){
@@ -2565,9 +3206,49 @@ public:
 	}
 
 	void connectionReset(){
-		printf("CONNECTION RESET\n");
-		shutdown(clientHandle,SHUT_RDWR);
-		clientHandle = -1;
+		connected = false;
+		bufferSize = 0;
+		tasks = queue<DebugPluginTask>();
+		rsps.clear();
+	}
+
+	//Get all the commands received by the socket thread
+	virtual void receive(){
+		int32_t value;
+		while(bufferSize != sizeof(buffer) && (value = server.read()) != -1){
+			if(value == TCP_SERVER_CONNECTED || value == TCP_SERVER_DISCONNECTED){
+				connectionReset();
+				connected = value == TCP_SERVER_CONNECTED;
+			} else {
+				buffer[bufferSize++] = value;
+			}
+		}
+		uint32_t offset = 0;
+		for(;bufferSize - offset >= 10;offset += 10){
+			char *cmd = buffer + offset;
+			bool wr = cmd[0];
+			uint32_t size = cmd[1];
+			uint32_t address = *((uint32_t*)(cmd + 2));
+			uint32_t data = *((uint32_t*)(cmd + 6));
+
+			if((address & ~ 0x4) == 0xF00F0000){
+				assert(size == 2);
+				DebugPluginTask t;
+				t.wr = wr;
+				t.address = address;
+				t.data = data;
+				tasks.push(t);
+			}
+		}
+		bufferSize -= offset;
+		memmove(buffer, buffer + offset, bufferSize);
+	}
+
+	virtual void flush(){
+		if(rsps.empty()) return;
+		server.write(&rsps[0], rsps.size()*4);
+		server.flush();
+		rsps.clear();
 	}
 
 
@@ -2577,58 +3258,20 @@ public:
 
 	virtual void postCycle(){
 		top->reset = top->debug_resetOut;
-		if(timeSpacer == 0){
-			if(clientHandle == -1){
-				clientHandle = accept(serverSocket, (struct sockaddr *) &serverStorage, &addr_size);
-				if(clientHandle != -1)
-					printf("CONNECTED\n");
-				timeSpacer = 1000;
-			}
-
-
-			if(clientHandle != -1 && taskValid == false){
-				int requiredSize = 1 + 1 + 4 + 4;
-				int n;
-				timeSpacer = 20;
-				if(ioctl(clientHandle,FIONREAD,&n) != 0){
-					connectionReset();
-				} else if(n >= requiredSize){
-					if(requiredSize != read(clientHandle,buffer,requiredSize)){
-						connectionReset();
-					} else {
-						bool wr = buffer[0];
-						uint32_t size = buffer[1];
-						uint32_t address = *((uint32_t*)(buffer + 2));
-						uint32_t data = *((uint32_t*)(buffer + 6));
-
-						if((address & ~ 0x4) == 0xF00F0000){
-							assert(size == 2);
-							timeSpacer = 100;
-
-							taskValid = true;
-							task.wr = wr;
-							task.address = address;
-							task.data = data;
-						}
-					}
-				} else {
-					int error = 0;
-					socklen_t len = sizeof (error);
-					int retval = getsockopt (clientHandle, SOL_SOCKET, SO_ERROR, &error, &len);
-					if (retval != 0 || error != 0) {
-						connectionReset();
-					}
-				}
-			}
-		} else {
-			timeSpacer--;
+		if(tasks.empty() && !taskValid && !rspFire){
+			flush();
+			receive();
+		}
+
+		if(!taskValid && !tasks.empty()){
+			task = tasks.front();
+			tasks.pop();
+			taskValid = true;
 		}
 	}
 
 	void sendRsp(uint32_t data){
-		if(clientHandle != -1){
-			if(send(clientHandle,&data,4,0) == -1) connectionReset();
-		}
+		if(connected) rsps.push_back(data);
 	}
 };
 #endif
@@ -2636,7 +3279,7 @@ public:
 #ifdef DEBUG_PLUGIN_STD
 class DebugPluginStd : public DebugPlugin{
 public:
-	DebugPluginStd(Workspace* ws) : DebugPlugin(ws){
+	DebugPluginStd(Workspace* ws, uint16_t port = 7893) : DebugPlugin(ws, port){
 
 	}
 
@@ -2645,8 +3288,6 @@ public:
 		top->debug_bus_cmd_valid = 0;
 	}
 
-	bool rspFire = false;
-
 	virtual void preCycle(){
 		DebugPlugin::preCycle();
 
@@ -2663,23 +3304,335 @@ public:
 		}
 	}
 
-	virtual void postCycle(){
-		DebugPlugin::postCycle();
+	virtual void postCycle(){
+		DebugPlugin::postCycle();
+
+		if(taskValid){
+			top->debug_bus_cmd_valid = 1;
+			top->debug_bus_cmd_payload_wr = task.wr;
+			top->debug_bus_cmd_payload_address = task.address;
+			top->debug_bus_cmd_payload_data = task.data;
+		}else {
+			top->debug_bus_cmd_valid = 0;
+			top->debug_bus_cmd_payload_wr = VL_RANDOM_I(1);
+			top->debug_bus_cmd_payload_address = VL_RANDOM_I(8);
+			top->debug_bus_cmd_payload_data = VL_RANDOM_I(32);
+		}
+	}
+};
+
+#endif
+
+#ifdef GDB_SERVER
+#if !defined(DEBUG_PLUGIN_EXTERNAL) || !defined(DEBUG_PLUGIN_STD)
+#error "GDB_SERVER replace the DebugPlugin TCP bridge of every test, it requires DEBUG_PLUGIN_EXTERNAL and DEBUG_PLUGIN_STD"
+#endif
+#include <functional>
+
+//GDB remote serial protocol stub driving the DebugPlugin bus. The registers are read by injecting "addi x0, xN, 0" and
+//"auipc x0, 0", and written with lui/addi (the pc through x1 and a jalr), while the memory is accessed straight in
+//Workspace::mem, the data cache being write-through. The caches are flushed before resuming the CPU when the memory was
+//modified. Software breakpoints are ebreak (or c.ebreak) patched in the memory. Packets with a bad checksum are nacked.
+//src/test/python/tool/gdbRsp.py is a scripted session against it.
+#define GDB_FLAGS 0xF00F0000
+#define GDB_INJECT 0xF00F0004
+#define GDB_POLL 1000
+#define GDB_PACKET_SIZE 0x4000 //Advertised to GDB, bounds the m / M lengths
+
+class GdbServer : public DebugPluginStd{
+public:
+	typedef std::function<void(vector<uint32_t> &rsps)> Continuation;
+	Continuation next;
+	string packet;
+	bool inPacket = false;
+	uint32_t checksumChars = 0;
+	uint8_t checksum;
+	bool running = false, interrupted = false, memoryDirty = false;
+	uint32_t pollTimer = 0;
+	uint32_t regs[33];
+	map<uint32_t, uint32_t> breakpoints;
+
+	GdbServer(Workspace* ws) : DebugPluginStd(ws, GDB_SERVER_PORT){
+
+	}
+
+	void busWrite(uint32_t address, uint32_t data){
+		DebugPluginTask t;
+		t.wr = true;
+		t.address = address;
+		t.data = data;
+		tasks.push(t);
+	}
+
+	void busRead(uint32_t address){
+		DebugPluginTask t;
+		t.wr = false;
+		t.address = address;
+		t.data = 0;
+		tasks.push(t);
+	}
+
+	void inject(uint32_t instruction){ busWrite(GDB_INJECT, instruction); }
+	//Run the continuation with the read results once all the queued bus accesses are done
+	void then(Continuation c){ next = c; }
+
+	void setReg(uint32_t id, uint32_t value){
+		inject(((value + 0x800) & 0xFFFFF000) | (id << 7) | 0x37); //lui
+		inject(((value & 0xFFF) << 20) | (id << 15) | (id << 7) | 0x13); //addi
+	}
+
+	void setPc(uint32_t pc){
+		setReg(1, pc);
+		inject(0x67 | (1 << 15)); //jalr x0, 0(x1)
+		setReg(1, regs[1]);
+		regs[32] = pc;
+	}
+
+	void readState(std::function<void()> done){
+		for(uint32_t id = 1;id < 32;id++){
+			inject(0x13 | (id << 15));
+			busRead(GDB_INJECT);
+		}
+		inject(0x17); //auipc x0, 0
+		busRead(GDB_INJECT);
+		then([this, done](vector<uint32_t> &rsps){
+			regs[0] = 0;
+			for(uint32_t id = 1;id < 33;id++) regs[id] = rsps[id-1];
+			done();
+		});
+	}
+
+	void resume(bool step){
+		if(memoryDirty){
+			#ifdef DBUS_CACHED
+			inject(0x500F); //Data cache flush
+			#endif
+			#ifdef IBUS_CACHED
+			inject(0x100F); //fence.i
+			#endif
+			memoryDirty = false;
+		}
+		busWrite(GDB_FLAGS, (step ? RISCV_SPINAL_FLAGS_STEP : 0) | RISCV_SPINAL_FLAGS_HALT_CLEAR);
+		running = true;
+		interrupted = false;
+		pollTimer = step ? 0 : GDB_POLL;
+	}
+
+	void halted(){
+		readState([this](){ reply(interrupted ? "S02" : "S05"); });
+	}
+
+	static string hex32(uint32_t value){
+		char str[9];
+		for(int i = 0;i < 4;i++) sprintf(str + i*2, "%02x", (value >> (i*8)) & 0xFF);
+		return string(str, 8);
+	}
+
+	static uint32_t parseHex32(const char *str){
+		uint32_t value = 0;
+		for(int i = 0;i < 4;i++){
+			uint32_t byte;
+			sscanf(str + i*2, "%2x", &byte);
+			value |= byte << (i*8);
+		}
+		return value;
+	}
+
+	void reply(string data){
+		uint8_t checksum = 0;
+		for(char c : data) checksum += c;
+		char tail[4];
+		sprintf(tail, "#%02x", checksum);
+		string frame = "$" + data + tail;
+		server.write(frame.c_str(), frame.size());
+		server.flush();
+	}
+
+	void memWrite(uint32_t address, uint32_t size, uint32_t data){
+		for(uint32_t i = 0;i < size;i++) *ws->mem.get(address + i) = data >> (i*8);
+		memoryDirty = true;
+	}
+
+	uint32_t memRead(uint32_t address, uint32_t size){
+		uint32_t data = 0;
+		for(uint32_t i = 0;i < size;i++) data |= ws->mem[address + i] << (i*8);
+		return data;
+	}
+
+	void handle(string &p){
+		const char *args = p.c_str() + 1;
+		switch(p[0]){
+		case '?':
+			if(running){
+				interrupted = true;
+				busWrite(GDB_FLAGS, RISCV_SPINAL_FLAGS_HALT_SET);
+			} else {
+				busWrite(GDB_FLAGS, RISCV_SPINAL_FLAGS_HALT_SET);
+				then([this](vector<uint32_t> &rsps){ running = true; interrupted = true; pollTimer = 0; });
+			}
+			break;
+		case 'g': {
+			string data;
+			for(uint32_t id = 0;id < 33;id++) data += hex32(regs[id]);
+			reply(data);
+		} break;
+		case 'G':
+			for(uint32_t id = 1;id < 33 && (id+1)*8 <= p.size()-1;id++){
+				uint32_t value = parseHex32(args + id*8);
+				if(value == regs[id]) continue;
+				if(id == 32) setPc(value); else { setReg(id, value); regs[id] = value; }
+			}
+			then([this](vector<uint32_t> &rsps){ reply("OK"); });
+			break;
+		case 'p': {
+			uint32_t id = strtoul(args, NULL, 16);
+			reply(id < 33 ? hex32(regs[id]) : "E01");
+		} break;
+		case 'P': {
+			uint32_t id = strtoul(args, NULL, 16);
+			const char *data = strchr(args, '=');
+			if(!data || strlen(data + 1) < 8) { reply("E01"); break; }
+			uint32_t value = parseHex32(data + 1);
+			if(id == 32) setPc(value); else if(id != 0 && id < 32) { setReg(id, value); regs[id] = value; }
+			then([this](vector<uint32_t> &rsps){ reply("OK"); });
+		} break;
+		case 'm': {
+			uint32_t address, length;
+			if(sscanf(args, "%x,%x", &address, &length) != 2 || length > GDB_PACKET_SIZE/2) { reply("E01"); break; }
+			string data;
+			char byte[3];
+			for(uint32_t i = 0;i < length;i++){
+				sprintf(byte, "%02x", ws->mem[address + i]);
+				data += byte;
+			}
+			reply(data);
+		} break;
+		case 'M': {
+			uint32_t address, length;
+			const char *data = strchr(args, ':');
+			if(sscanf(args, "%x,%x", &address, &length) != 2 || !data || length > GDB_PACKET_SIZE/2 || strlen(data + 1) < length*2) { reply("E01"); break; }
+			data++;
+			for(uint32_t i = 0;i < length;i++){
+				uint32_t byte;
+				sscanf(data + i*2, "%2x", &byte);
+				memWrite(address + i, 1, byte);
+			}
+			reply("OK");
+		} break;
+		case 'Z':
+		case 'z': {
+			uint32_t type, address, kind;
+			if(sscanf(args, "%x,%x,%x", &type, &address, &kind) != 3) { reply("E01"); break; }
+			if(type != 0 || (kind != 2 && kind != 4)) { reply(""); break; }
+			if(p[0] == 'Z'){
+				if(breakpoints.count(address) == 0) breakpoints[address] = memRead(address, kind);
+				memWrite(address, kind, kind == 4 ? 0x00100073 : 0x9002);
+			} else if(breakpoints.count(address)){
+				memWrite(address, kind, breakpoints[address]);
+				breakpoints.erase(address);
+			}
+			reply("OK");
+		} break;
+		case 'c':
+		case 's':
+			if(p.size() > 1) setPc(strtoul(args, NULL, 16));
+			resume(p[0] == 's');
+			break;
+		case 'D':
+			for(auto &b : breakpoints) memWrite(b.first, (b.second & 3) == 3 ? 4 : 2, b.second);
+			breakpoints.clear();
+			reply("OK");
+			resume(false);
+			running = false;
+			break;
+		case 'k':
+			resume(false);
+			running = false;
+			break;
+		case 'H': reply("OK"); break;
+		case 'q':
+			if(p.compare(0, 10, "qSupported") == 0) {
+				char size[32];
+				sprintf(size, "PacketSize=%x", GDB_PACKET_SIZE);
+				reply(size);
+			} else if(p == "qAttached") reply("1");
+			else reply("");
+			break;
+		default: reply(""); break;
+		}
+	}
+
+	virtual void flush(){
+		if(!next) return;
+		Continuation c = next;
+		next = nullptr;
+		vector<uint32_t> results;
+		results.swap(rsps);
+		c(results);
+	}
+
+	virtual void receive(){
+		if(next || !tasks.empty()) return;
+		int32_t value;
+		while((value = server.read()) != -1){
+			if(value == TCP_SERVER_CONNECTED || value == TCP_SERVER_DISCONNECTED){
+				connectionReset();
+				connected = value == TCP_SERVER_CONNECTED;
+				inPacket = false;
+				continue;
+			}
+			if(!inPacket){
+				if(value == '$'){
+					inPacket = true;
+					packet.clear();
+				} else if(value == 0x03 && running){
+					interrupted = true;
+					busWrite(GDB_FLAGS, RISCV_SPINAL_FLAGS_HALT_SET);
+					pollTimer = 0;
+					return;
+				}
+				continue;
+			}
+			if(checksumChars){
+				checksum -= (isdigit(value) ? value - '0' : (tolower(value) - 'a' + 10)) << (4*(checksumChars-1));
+				if(--checksumChars == 0){
+					inPacket = false;
+					if(checksum != 0){
+						server.write('-');
+						server.flush();
+						continue;
+					}
+					server.write('+');
+					handle(packet);
+					return;
+				}
+				continue;
+			}
+			if(value == '#') {
+				checksumChars = 2;
+				checksum = 0;
+				for(char c : packet) checksum += c;
+			} else {
+				packet += value;
+			}
+		}
 
-		if(taskValid){
-			top->debug_bus_cmd_valid = 1;
-			top->debug_bus_cmd_payload_wr = task.wr;
-			top->debug_bus_cmd_payload_address = task.address;
-			top->debug_bus_cmd_payload_data = task.data;
-		}else {
-			top->debug_bus_cmd_valid = 0;
-			top->debug_bus_cmd_payload_wr = VL_RANDOM_I(1);
-			top->debug_bus_cmd_payload_address = VL_RANDOM_I(8);
-			top->debug_bus_cmd_payload_data = VL_RANDOM_I(32);
+		if(running){
+			if(pollTimer != 0) {
+				pollTimer--;
+				return;
+			}
+			pollTimer = GDB_POLL;
+			busRead(GDB_FLAGS);
+			then([this](vector<uint32_t> &rsps){
+				if(rsps[0] & RISCV_SPINAL_FLAGS_HALT){
+					running = false;
+					halted();
+				}
+			});
 		}
 	}
 };
-
 #endif
 
 #ifdef DEBUG_PLUGIN_AVALON
@@ -2695,8 +3648,6 @@ public:
 		top->debugBusAvalon_write = 0;
 	}
 
-	bool rspFire = false;
-
 	virtual void preCycle(){
 		DebugPlugin::preCycle();
 
@@ -2777,8 +3728,12 @@ void Workspace::fillSimELements(){
 		simElements.push_back(new DBusCachedWishbone(this));
 	#endif
 	#ifdef DEBUG_PLUGIN_STD
+	#ifdef GDB_SERVER
+		simElements.push_back(new GdbServer(this));
+	#else
 		simElements.push_back(new DebugPluginStd(this));
 	#endif
+	#endif
 	#ifdef DEBUG_PLUGIN_AVALON
 		simElements.push_back(new DebugPluginAvalon(this));
 	#endif
@@ -2997,19 +3952,7 @@ public:
 #include<stdlib.h>
 #include<unistd.h>
 #include <netinet/tcp.h>
-
-#define RISCV_SPINAL_FLAGS_RESET 1<<0
-#define RISCV_SPINAL_FLAGS_HALT 1<<1
-#define RISCV_SPINAL_FLAGS_PIP_BUSY 1<<2
-#define RISCV_SPINAL_FLAGS_IS_IN_BREAKPOINT 1<<3
-#define RISCV_SPINAL_FLAGS_STEP 1<<4
-#define RISCV_SPINAL_FLAGS_PC_INC 1<<5
-
-#define RISCV_SPINAL_FLAGS_RESET_SET 1<<16
-#define RISCV_SPINAL_FLAGS_HALT_SET 1<<17
-
-#define RISCV_SPINAL_FLAGS_RESET_CLEAR 1<<24
-#define RISCV_SPINAL_FLAGS_HALT_CLEAR 1<<25
+#include <chrono>
 
 class DebugPluginTest : public WorkspaceRegression{
 public:
@@ -3166,6 +4109,120 @@ public:
 	}
 };
 
+//Load DEBUG_BENCH_SIZE bytes in the halted CPU memory by injecting lui/addi/sw through the debug bus, all the commands
+//of a chunk being sent in one packet, then read back a few words to check them and report the throughput
+#define DEBUG_BENCH_SIZE 4096
+#define DEBUG_BENCH_ADDRESS 0x80010000
+
+class DebugPluginBench : public WorkspaceRegression{
+public:
+	pthread_t clientThreadId;
+	bool clientSuccess = false, clientFail = false;
+	int clientSocket = -1;
+	vector<char> packet;
+
+	static void* clientThreadWrapper(void *debugModule){
+		((DebugPluginBench*)debugModule)->clientThread();
+		return NULL;
+	}
+
+	void accessCmd(bool wr, uint32_t address, uint32_t data){
+		char cmd[10];
+		cmd[0] = wr;
+		cmd[1] = 2;
+		*((uint32_t*) (cmd + 2)) = address;
+		*((uint32_t*) (cmd + 6)) = data;
+		packet.insert(packet.end(), cmd, cmd + 10);
+	}
+
+	void inject(uint32_t instruction){ accessCmd(true, 0xF00F0004, instruction); }
+
+	//Send the packet and get the responses of its reads
+	bool transfer(uint32_t *rsps, uint32_t rspCount){
+		for(uint32_t offset = 0;offset != packet.size();){
+			int n = send(clientSocket, &packet[offset], packet.size() - offset, 0);
+			if(n <= 0) return false;
+			offset += n;
+		}
+		packet.clear();
+		for(uint32_t offset = 0;offset != rspCount*4;){
+			int n = recv(clientSocket, ((char*)rsps) + offset, rspCount*4 - offset, 0);
+			if(n <= 0) return false;
+			offset += n;
+		}
+		return true;
+	}
+
+	uint32_t wordAt(uint32_t address){ return address*0x9E3779B1; }
+
+	void clientThread(){
+		struct sockaddr_in serverAddr;
+		clientSocket = socket(PF_INET, SOCK_STREAM, 0);
+		int flag = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int));
+		serverAddr.sin_family = AF_INET;
+		serverAddr.sin_port = htons(7893);
+		serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		memset(serverAddr.sin_zero, '\0', sizeof serverAddr.sin_zero);
+		connect(clientSocket, (struct sockaddr *) &serverAddr, sizeof serverAddr);
+
+		while(resetDone != true){usleep(100);}
+		uint32_t rsp[4];
+		do{
+			accessCmd(false, 0xF00F0000, 0);
+			if(!transfer(rsp, 1)) { clientFail = true; return; }
+			usleep(100);
+		} while((rsp[0] & RISCV_SPINAL_FLAGS_HALT) == 0);
+
+		uint64_t startCycles = instanceCycles;
+		auto startTime = std::chrono::high_resolution_clock::now();
+		inject((DEBUG_BENCH_ADDRESS & 0xFFFFF000) | (2 << 7) | 0x37); //lui x2, DEBUG_BENCH_ADDRESS
+		for(uint32_t chunk = 0;chunk < DEBUG_BENCH_SIZE;chunk += 256){
+			for(uint32_t address = DEBUG_BENCH_ADDRESS + chunk;address < DEBUG_BENCH_ADDRESS + chunk + 256;address += 4){
+				uint32_t data = wordAt(address);
+				inject(((data + 0x800) & 0xFFFFF000) | (1 << 7) | 0x37); //lui x1, hi
+				inject(((data & 0xFFF) << 20) | (1 << 15) | (1 << 7) | 0x13); //addi x1, x1, lo
+				inject((1 << 20) | (2 << 15) | (2 << 12) | 0x23); //sw x1, 0(x2)
+				inject((4 << 20) | (2 << 15) | (2 << 7) | 0x13); //addi x2, x2, 4
+			}
+			accessCmd(false, 0xF00F0000, 0);
+			if(!transfer(rsp, 1)) { clientFail = true; return; }
+		}
+		uint64_t cycles = instanceCycles - startCycles;
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		uint32_t checks[] = {DEBUG_BENCH_ADDRESS, DEBUG_BENCH_ADDRESS + DEBUG_BENCH_SIZE/2, DEBUG_BENCH_ADDRESS + DEBUG_BENCH_SIZE - 4};
+		for(uint32_t address : checks){
+			inject(((address + 0x800) & 0xFFFFF000) | (2 << 7) | 0x37); //lui x2, address
+			inject(((address & 0xFFF) << 20) | (2 << 15) | (2 << 12) | (1 << 7) | 0x03); //lw x1, lo(x2)
+			inject(0x13 + (1 << 15)); //Read x1
+			accessCmd(false, 0xF00F0004, 0);
+			if(!transfer(rsp, 1)) { clientFail = true; return; }
+			if(rsp[0] != wordAt(address)){
+				printf("DebugPluginBench wrong data at %x : %x\n", address, rsp[0]);
+				clientFail = true; return;
+			}
+		}
+
+		cout << "DebugPluginBench : " << DEBUG_BENCH_SIZE << " bytes in " << cycles << " cycles (" << double(DEBUG_BENCH_SIZE)/cycles << " bytes/cycle), " << DEBUG_BENCH_SIZE/seconds/1024 << " KB/s" << endl;
+		clientSuccess = true;
+	}
+
+	DebugPluginBench() : WorkspaceRegression("DebugPluginBench") {
+		loadHex(string(REGRESSION_PATH) + "../../resources/hex/debugPlugin.hex");
+		pthread_create(&clientThreadId, NULL, &clientThreadWrapper, this);
+	}
+
+	virtual ~DebugPluginBench(){
+		if(clientSocket != -1) close(clientSocket);
+	}
+
+	virtual void checks(){
+		if(clientSuccess) pass();
+		if(clientFail) fail();
+	}
+};
+
 #endif
 
 
@@ -3265,9 +4322,112 @@ void captureCtrlC(){
 
 #if defined(LINUX_SOC) || defined(LINUX_REGRESSION)
 #include <queue>
+#include "../common/console.h"
+
+#ifdef TRAP_PROFILER
+//Cost of the machine mode emulator : from each trap into machine mode from a lower privilege to the mret back,
+//cycles and occurrences per trap cause, per emulated instruction for the illegal instruction traps and per SBI call.
+class TrapProfiler{
+public:
+	struct Entry{
+		uint64_t count = 0, cycles = 0;
+	};
+	map<string, Entry> entries;
+	string current;
+	uint64_t enterCycle = 0;
+	bool inside = false;
+
+	static string amoName(uint32_t instruction){
+		const char* names[] = {"amoadd", "amoswap", "lr", "sc", "amoxor", "?", "?", "?", "amoor", "?", "?", "?", "amoand", "?", "?", "?",
+							   "amomin", "?", "?", "?", "amomax", "?", "?", "?", "amominu", "?", "?", "?", "amomaxu", "?", "?", "?"};
+		return names[instruction >> 27];
+	}
+
+	static string csrName(uint32_t csr){
+		switch(csr){
+		case 0xC00: return "rdcycle";
+		case 0xC01: return "rdtime";
+		case 0xC02: return "rdinstret";
+		case 0xC80: return "rdcycleh";
+		case 0xC81: return "rdtimeh";
+		case 0xC82: return "rdinstreth";
+		}
+		stringstream ss;
+		ss << "csr 0x" << hex << csr;
+		return ss.str();
+	}
+
+	static string name(bool interrupt, int32_t cause, uint32_t value, uint32_t a7){
+		stringstream ss;
+		if(interrupt) {
+			ss << "interrupt " << cause;
+		} else if(cause == 2 && (value & 0x7F) == 0x2F){
+			ss << "illegal " << amoName(value);
+		} else if(cause == 2 && (value & 0x7F) == 0x73 && ((value >> 12) & 0x7) != 0){
+			ss << "illegal " << csrName(value >> 20);
+		} else if(cause == 2){
+			ss << "illegal 0x" << hex << value;
+		} else if(cause == 9){
+			ss << "sbi " << a7;
+		} else {
+			ss << "exception " << cause;
+		}
+		return ss.str();
+	}
+
+	void trap(bool interrupt, int32_t cause, uint32_t value, uint32_t fromPrivilege, uint32_t toPrivilege, uint32_t a7, uint64_t cycle){
+		if(toPrivilege != 3 || fromPrivilege == 3) return;
+		current = name(interrupt, cause, value, a7);
+		enterCycle = cycle;
+		inside = true;
+	}
+
+	void mret(uint32_t toPrivilege, uint64_t cycle){
+		if(!inside || toPrivilege == 3) return;
+		Entry &e = entries[current];
+		e.count++;
+		e.cycles += cycle - enterCycle;
+		inside = false;
+	}
+
+	void report(uint64_t totalCycles){
+		vector<pair<string, Entry>> ranked(entries.begin(), entries.end());
+		sort(ranked.begin(), ranked.end(), [](const pair<string, Entry> &a, const pair<string, Entry> &b){ return a.second.cycles > b.second.cycles; });
+		uint64_t cycles = 0;
+		for(auto &e : ranked) cycles += e.second.cycles;
+		printf("TRAP PROFILER : %ld cycles in the machine mode emulator (%.2f%% of %ld)\n", cycles, 100.0*cycles/max<uint64_t>(1, totalCycles), totalCycles);
+		for(auto &e : ranked){
+			printf("%-20s count=%-10ld cycles=%-12ld avg=%-8.1f %.2f%%\n", e.first.c_str(), e.second.count, e.second.cycles,
+				1.0*e.second.cycles/e.second.count, 100.0*e.second.cycles/max<uint64_t>(1, totalCycles));
+		}
+	}
+};
+#endif
+
+//Host file device, to move bulk data in and out of the guest without going through the console. The guest writes the
+//physical address of a descriptor into HOST_FILE_CMD, the transfer is then done at once between the host file and the
+//guest memory, and its result is written back in the descriptor and readable from HOST_FILE_STATUS. The transfers are
+//not coherent with the data cache. Descriptor words :
+//- op : HOST_FILE_READ, HOST_FILE_WRITE or HOST_FILE_SIZE
+//- physical address of the file name, null terminated, relative to HOST_FILE_PATH
+//- file offset
+//- physical address of the buffer
+//- length, at most HOST_FILE_LENGTH_MAX
+//- result : bytes transferred (or file size), -1 on error
+#define HOST_FILE_CMD 0xFFFFFFD0
+#define HOST_FILE_STATUS 0xFFFFFFD4
+#define HOST_FILE_READ 1
+#define HOST_FILE_WRITE 2
+#define HOST_FILE_SIZE 3
+#ifndef HOST_FILE_PATH
+#define HOST_FILE_PATH "./"
+#endif
+#define HOST_FILE_LENGTH_MAX 0x4000000 //RAM of the Linux SoC
+
 class LinuxSoc : public Workspace{
 public:
     queue <char> customCin;
+    Console *console;
     void pushCin(string m){
         for(char& c : m) {
             customCin.push(c);
@@ -3280,13 +4440,27 @@ public:
 		captureCtrlC();
 	    #endif
 		stdoutNonBuffered();
+		console = Console::get();
 	}
 
 	virtual ~LinuxSoc(){
 	    #ifdef WITH_USER_IO
 	    stdinRestore();
 	    #endif
+	    #ifdef TRAP_PROFILER
+	    trapProfiler.report(instanceCycles);
+	    #endif
+	}
+
+	#ifdef TRAP_PROFILER
+	TrapProfiler trapProfiler;
+	virtual void onRefTrap(bool interrupt, int32_t cause, uint32_t value, uint32_t fromPrivilege, uint32_t toPrivilege) {
+		trapProfiler.trap(interrupt, cause, value, fromPrivilege, toPrivilege, riscvRef.regs[17], instanceCycles);
+	}
+	virtual void onRefMret(uint32_t toPrivilege) {
+		trapProfiler.mret(toPrivilege, instanceCycles);
 	}
+	#endif
 	virtual bool isDBusCheckedRegion(uint32_t address){ return true;}
 	virtual bool isPerifRegion(uint32_t addr) { return (addr & 0xF0000000) == 0xF0000000 || (addr & 0xE0000000) == 0xE0000000;}
     virtual bool isMmuRegion(uint32_t addr) { return true; }
@@ -3303,15 +4477,13 @@ public:
     		case 0xFFFFFFF8:
     		    if(wr){
     		        char c = (char)*data;
-                    cout << c;
+                    console->write(c);
                     logTraces << c;
-                    logTraces.flush();
                     onStdout(c);
 				} else {
 				    #ifdef WITH_USER_IO
-					if(stdinNonEmpty()){
-						char c;
-						read(0, &c, 1);
+					int32_t c;
+					if((c = console->read()) != -1){
 						*data = c;
 					} else
 					#endif
@@ -3323,6 +4495,8 @@ public:
 					}
 				}
 				break;
+    		case HOST_FILE_CMD: if(wr) hostFileStatus = hostFile(*data); else *data = hostFileStatus; break;
+    		case HOST_FILE_STATUS: if(wr) fail(); else *data = hostFileStatus; break;
     		case 0xFFFFFFFC: fail(); break; //Simulation end
     		default: cout << "Unmapped peripheral access : addr=0x" << hex << addr << " wr=" << wr << " mask=0x" << mask << " data=0x" << data << dec << endl; fail(); break;
     	}
@@ -3333,39 +4507,229 @@ public:
     virtual void onStdout(char c){
 
     }
+
+    uint32_t hostFileStatus = 0;
+
+    uint32_t memWord(uint32_t address){
+        uint32_t value;
+        mem.read(address, 4, (uint8_t*)&value);
+        return value;
+    }
+
+    //Copy page by page between the host and the DUT / golden model memories
+    void hostToGuest(uint32_t address, uint8_t *data, uint32_t length){
+        while(length){
+            uint32_t size = min<uint32_t>(length, 0x100000 - (address & 0xFFFFF));
+            memcpy(mem.get(address), data, size);
+            if(riscvRefEnable) memcpy(riscvRef.mem.get(address), data, size);
+            address += size; data += size; length -= size;
+        }
+    }
+
+    void guestToHost(uint32_t address, uint8_t *data, uint32_t length){
+        while(length){
+            uint32_t size = min<uint32_t>(length, 0x100000 - (address & 0xFFFFF));
+            memcpy(data, mem.get(address), size);
+            address += size; data += size; length -= size;
+        }
+    }
+
+    uint32_t hostFile(uint32_t descriptor){
+        uint32_t op = memWord(descriptor + 0);
+        uint32_t nameAddress = memWord(descriptor + 4);
+        uint32_t offset = memWord(descriptor + 8);
+        uint32_t buffer = memWord(descriptor + 12);
+        uint32_t length = memWord(descriptor + 16);
+
+        string name;
+        for(uint32_t i = 0;i < 256;i++){
+            char c = mem[nameAddress + i];
+            if(c == 0) break;
+            name += c;
+        }
+        uint32_t result = -1;
+        bool transfer = op == HOST_FILE_READ || op == HOST_FILE_WRITE;
+        bool lengthOk = !transfer || (length <= HOST_FILE_LENGTH_MAX && buffer + length >= buffer);
+        if(lengthOk && !name.empty() && name[0] != '/' && name.find("..") == string::npos){
+            string path = string(HOST_FILE_PATH) + name;
+            FILE *file = fopen(path.c_str(), op == HOST_FILE_WRITE ? "r+b" : "rb");
+            if(!file && op == HOST_FILE_WRITE) file = fopen(path.c_str(), "w+b");
+            if(file){
+                vector<uint8_t> data(transfer ? length : 0);
+                switch(op){
+                case HOST_FILE_READ:
+                    if(fseek(file, offset, SEEK_SET) == 0){
+                        result = fread(data.data(), 1, length, file);
+                        hostToGuest(buffer, data.data(), result);
+                    }
+                    break;
+                case HOST_FILE_WRITE:
+                    if(fseek(file, offset, SEEK_SET) == 0){
+                        guestToHost(buffer, data.data(), length);
+                        result = fwrite(data.data(), 1, length, file);
+                    }
+                    break;
+                case HOST_FILE_SIZE:
+                    if(fseek(file, 0, SEEK_END) == 0) result = ftell(file);
+                    break;
+                }
+                fclose(file);
+            }
+        }
+        hostToGuest(descriptor + 20, (uint8_t*)&result, 4);
+        return result;
+    }
 };
 
 
+#include <functional>
+#include <array>
+//Scripted console : a list of steps, each one waiting for some patterns of the console output, with a timeout in
+//simulated cycles. The patterns of all the steps are matched incrementally by a single Aho-Corasick automaton, so each
+//output character only cost a table lookup. Patterns added with expectAny are matched whatever the current step is.
+class ConsoleScript{
+public:
+	#define CONSOLE_SCRIPT_ANY 0xFFFFFFFF
+	struct Expect{
+		string pattern;
+		uint32_t step;
+		std::function<void()> action;
+	};
+	vector<Expect> expects;
+	vector<uint64_t> timeouts;
+	vector<array<int32_t, 256>> transitions;
+	vector<vector<uint32_t>> outputs;
+	uint32_t node = 0, step = 0;
+	uint64_t deadline = ~0l;
+
+	//Start a new step, which fail after timeout cycles
+	ConsoleScript& wait(uint64_t timeout){
+		timeouts.push_back(timeout);
+		return *this;
+	}
+
+	ConsoleScript& expect(string pattern, std::function<void()> action){
+		expects.push_back({pattern, (uint32_t)timeouts.size()-1, action});
+		return *this;
+	}
+
+	ConsoleScript& expectAny(string pattern, std::function<void()> action){
+		expects.push_back({pattern, CONSOLE_SCRIPT_ANY, action});
+		return *this;
+	}
+
+	void build(uint64_t now){
+		array<int32_t, 256> empty;
+		empty.fill(-1);
+		transitions.assign(1, empty);
+		outputs.assign(1, {});
+		for(uint32_t id = 0;id < expects.size();id++){
+			uint32_t n = 0;
+			for(char c : expects[id].pattern){
+				int32_t &t = transitions[n][(uint8_t)c];
+				if(t == -1){
+					t = transitions.size();
+					transitions.push_back(empty);
+					outputs.push_back({});
+				}
+				n = transitions[n][(uint8_t)c];
+			}
+			outputs[n].push_back(id);
+		}
+		//Breadth first, turn the trie into a complete automaton, using the failure links
+		vector<int32_t> failure(transitions.size(), 0);
+		queue<uint32_t> pendings;
+		for(int32_t &t : transitions[0]){
+			if(t == -1) t = 0; else pendings.push(t);
+		}
+		while(!pendings.empty()){
+			uint32_t n = pendings.front(); pendings.pop();
+			outputs[n].insert(outputs[n].end(), outputs[failure[n]].begin(), outputs[failure[n]].end());
+			for(uint32_t c = 0;c < 256;c++){
+				int32_t &t = transitions[n][c];
+				if(t == -1){
+					t = transitions[failure[n]][c];
+				} else {
+					failure[t] = transitions[failure[n]][c];
+					pendings.push(t);
+				}
+			}
+		}
+		goTo(0, now);
+	}
+
+	void goTo(uint32_t step, uint64_t now){
+		this->step = step;
+		node = 0;
+		deadline = step < timeouts.size() ? now + timeouts[step] : ~0l;
+	}
+
+	void next(uint64_t now){
+		goTo(step + 1, now);
+	}
+
+	void feed(char c){
+		node = transitions[node][(uint8_t)c];
+		for(uint32_t id : outputs[node]){
+			Expect &e = expects[id];
+			if(e.step == step || e.step == CONSOLE_SCRIPT_ANY){
+				e.action();
+				return;
+			}
+		}
+	}
+
+	bool timedOut(uint64_t now){
+		return now >= deadline;
+	}
+};
+
 class LinuxRegression: public LinuxSoc{
 public:
-    string pendingLine = "";
-    bool pendingLineContain(string m) {
-        return strstr(pendingLine.c_str(), m.c_str()) != NULL;
-    }
+	ConsoleScript script;
 
-    enum State{LOGIN, ECHO_FILE, HEXDUMP, HEXDUMP_CHECK, PASS};
-    State state = LOGIN;
 	LinuxRegression(string name) : LinuxSoc(name) {
-
+		//Login, write a file, and check its hexdump
+		auto send = [this](string m){ return [this, m](){ pushCin(m); script.next(instanceCycles); }; };
+		script.expectAny("Kernel panic", [this](){ fail(); });
+		script.wait(2000000000l).expect("buildroot login:", send("root\n"));
+		script.wait(100000000l).expect("# ", send("echo \"miaou\" > test.txt\n"));
+		script.wait(100000000l).expect("# ", send("hexdump -C test.txt\n"));
+		script.wait(100000000l).expect("00000000  6d 69 61 6f 75 0a  ", [this](){ script.next(instanceCycles); });
+		script.wait(100000000l).expect("# ", [this](){ pass(); });
+		script.build(0);
 	}
 
     ~LinuxRegression() {
     }
 
+	virtual void checks(){
+		LinuxSoc::checks();
+		if(script.timedOut(instanceCycles)){
+			cout << endl << "LINUX SCRIPT TIMEOUT at step " << script.step << endl;
+			fail();
+		}
+	}
 
     virtual void onStdout(char c){
-        pendingLine += c;
-        switch(state){
-        case LOGIN: if (pendingLineContain("buildroot login:")) { pushCin("root\n"); state = ECHO_FILE; } break;
-        case ECHO_FILE: if (pendingLineContain("# ")) { pushCin("echo \"miaou\" > test.txt\n"); state = HEXDUMP; pendingLine = "";} break;
-        case HEXDUMP: if (pendingLineContain("# ")) { pushCin("hexdump -C test.txt\n"); state = HEXDUMP_CHECK; pendingLine = "";} break;
-        case HEXDUMP_CHECK: if (pendingLineContain("00000000  6d 69 61 6f 75 0a  ")) { pushCin(""); state = PASS; pendingLine = "";} break;
-        case PASS: if (pendingLineContain("# ")) { pass(); } break;
-        }
-        if(c == '\n' || pendingLine.length() > 200) pendingLine = "";
+        script.feed(c);
     }
 };
 
+//Bare metal test of the host file device (raw/hostFile), with the pass / fail ports of the other raw tests
+class HostFileRegression : public LinuxSoc{
+public:
+	HostFileRegression() : LinuxSoc("hostFile") {
+		remove(HOST_FILE_PATH "hostFile.bin");
+	}
+
+	virtual void dBusAccess(uint32_t addr,bool wr, uint32_t size,uint32_t mask, uint32_t *data, bool *error) {
+		if(wr && addr == 0xF00FFF20u) { pass(); return; }
+		if(wr && addr == 0xF00FFF24u) { cout << "TEST ERROR CODE " << *data << endl; fail(); return; }
+		LinuxSoc::dBusAccess(addr, wr, size, mask, data, error);
+	}
+};
+
 #endif
 
 string riscvTestMain[] = {
@@ -3640,6 +5004,359 @@ static void multiThreadedExecute(queue<std::function<void()>> &lambdas){
 	}
 }
 
+#ifdef FUZZ
+//Constrained random program generator. The generated stream only use forward jumps, aligned memory accesses into a
+//private data region and a trap handler which skip the ecall, so any mismatch with the golden model is a CPU issue.
+class FuzzProgram{
+public:
+	enum Fixup {NONE, BRANCH, JAL, AUIPC_PAIR};
+	class Item{
+	public:
+		uint32_t word[2];
+		uint32_t size; //In bytes, 8 for auipc/addi pairs
+		Fixup fixup;
+		uint32_t target;
+	};
+	class Segment{
+	public:
+		uint32_t address;
+		vector<uint8_t> data;
+	};
+
+	static const uint32_t codeBase = 0x80000000u;
+	static const uint32_t handlerBase = 0x80300000u;
+	static const uint32_t pageTableBase = 0x80400000u;
+	static const uint32_t dataBase = 0x80800000u;
+	static const uint32_t dataSize = 4096;
+	static const uint32_t rDataBase = 30;  //Hold the data region address + 2048
+	static const uint32_t rTrap = 31;      //Scratch of the trap handler and of the prologue/epilogue
+
+	vector<Item> items;
+	vector<Segment> segments;
+	uint32_t bodyStart, bodyEnd;
+	uint64_t state;
+	bool supervisor = false;
+
+	FuzzProgram(uint32_t seed, uint32_t length){
+		state = seed * 0x9E3779B97F4A7C15ull + 0x1234567;
+		for(int i = 0;i < 8;i++) rand32();
+
+		#if defined(MMU) && defined(SUPERVISOR)
+		supervisor = rand32() & 1;
+		#endif
+		uint32_t dataVirtual = dataBase;
+		if(supervisor) dataVirtual = (0x100 + rand32() % 0x100) << 22; //Somewhere in 0x40000000-0x7FFFFFFF
+
+		//Data region
+		Segment data;
+		data.address = dataBase;
+		for(uint32_t i = 0;i < dataSize;i++) data.data.push_back(rand32());
+		segments.push_back(data);
+
+		//Prologue
+		li(rDataBase, dataVirtual + 2048);
+		for(uint32_t reg = 1;reg < 30;reg++) li(reg, rand32());
+		#ifdef CSR
+		li(rTrap, handlerBase);
+		add(i(0x73, 1, 0, rTrap, 0x305)); //csrw mtvec
+		#endif
+		if(supervisor){
+			Segment pageTable;
+			pageTable.address = pageTableBase;
+			pageTable.data.resize(4096, 0);
+			megaPage(pageTable, codeBase, codeBase);
+			megaPage(pageTable, dataVirtual, dataBase);
+			megaPage(pageTable, 0xF0000000u, 0xF0000000u);
+			segments.push_back(pageTable);
+
+			li(rTrap, 0x80000000u | (pageTableBase >> 12));
+			add(i(0x73, 1, 0, rTrap, 0x180)); //csrw satp
+			add(0x12000073); //sfence.vma
+			li(rTrap, 0x1800);
+			add(i(0x73, 3, 0, rTrap, 0x300)); //csrc mstatus, MPP
+			li(rTrap, 0x0800);
+			add(i(0x73, 2, 0, rTrap, 0x300)); //csrs mstatus, MPP = S
+			addFixup(u(0x17, rTrap, 0), i(0x13, 0, rTrap, rTrap, 0), 8, AUIPC_PAIR, items.size() + 3); //la rTrap, body
+			add(i(0x73, 1, 0, rTrap, 0x341)); //csrw mepc
+			add(0x30200073); //mret
+		}
+
+		//Body
+		bodyStart = items.size();
+		bodyEnd = bodyStart + length;
+		while(items.size() < bodyEnd) body();
+
+		//Epilogue, report the success
+		li(rTrap, 0xF00FFF20u);
+		add(s(0x23, 2, rTrap, 0, 0));
+		add(0x0000006F); //j .
+
+		//Trap handler, skip the instruction which trapped (only ecall)
+		Segment handler;
+		handler.address = handlerBase;
+		push32(handler, i(0x73, 2, rTrap, 0, 0x341)); //csrr rTrap, mepc
+		push32(handler, i(0x13, 0, rTrap, rTrap, 4));
+		push32(handler, i(0x73, 1, 0, rTrap, 0x341)); //csrw mepc, rTrap
+		push32(handler, 0x30200073); //mret
+		segments.push_back(handler);
+	}
+
+	uint32_t rand32(){
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state >> 16;
+	}
+
+	uint32_t rd() { return 1 + rand32() % 29; }
+	uint32_t rs() { return rand32() % 32; }
+	uint32_t rc() { return 8 + rand32() % 8; }
+
+	static uint32_t r(uint32_t op, uint32_t f3, uint32_t f7, uint32_t rd, uint32_t rs1, uint32_t rs2) { return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op; }
+	static uint32_t i(uint32_t op, uint32_t f3, uint32_t rd, uint32_t rs1, uint32_t imm) { return ((imm & 0xFFF) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op; }
+	static uint32_t s(uint32_t op, uint32_t f3, uint32_t rs1, uint32_t rs2, uint32_t imm) { return (((imm >> 5) & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((imm & 0x1F) << 7) | op; }
+	static uint32_t u(uint32_t op, uint32_t rd, uint32_t imm) { return (imm & 0xFFFFF000) | (rd << 7) | op; }
+	static uint32_t bImm(uint32_t imm) { return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3F) << 25) | (((imm >> 1) & 0xF) << 8) | (((imm >> 11) & 1) << 7); }
+	static uint32_t jImm(uint32_t imm) { return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3FF) << 21) | (((imm >> 11) & 1) << 20) | (((imm >> 12) & 0xFF) << 12); }
+
+	void addFixup(uint32_t word0, uint32_t word1, uint32_t size, Fixup fixup, uint32_t target){
+		Item item;
+		item.word[0] = word0;
+		item.word[1] = word1;
+		item.size = size;
+		item.fixup = fixup;
+		item.target = target;
+		items.push_back(item);
+	}
+	void add(uint32_t word) { addFixup(word, 0, 4, NONE, 0); }
+	void addPair(uint32_t word0, uint32_t word1) { addFixup(word0, word1, 8, NONE, 0); }
+	void addC(uint32_t half) { addFixup(half, 0, 2, NONE, 0); }
+
+	void li(uint32_t reg, uint32_t value){
+		addPair(u(0x37, reg, value + 0x800), i(0x13, 0, reg, reg, value));
+	}
+
+	void megaPage(Segment &pageTable, uint32_t virtualAddress, uint32_t physicalAddress){
+		uint32_t pte = ((physicalAddress >> 12) << 10) | 0xCF; //V R W X A D
+		memcpy(&pageTable.data[(virtualAddress >> 22)*4], &pte, 4);
+	}
+
+	static void push32(Segment &segment, uint32_t word){
+		for(int b = 0;b < 4;b++) segment.data.push_back(word >> (b*8));
+	}
+
+	//Random offset from rDataBase, aligned on size, which stay inside the data region
+	uint32_t dataOffset(uint32_t size) { return ((rand32() % dataSize) & ~(size-1)) - 2048; }
+
+	void body(){
+		uint32_t forward = min<uint32_t>(items.size() + 1 + rand32() % 8, bodyEnd);
+		switch(rand32() % 16){
+		case 0: case 1: case 2: { //ALU register
+			static const uint32_t ops[][2] = {{0,0},{0,0x20},{1,0},{2,0},{3,0},{4,0},{5,0},{5,0x20},{6,0},{7,0}};
+			const uint32_t *op = ops[rand32() % 10];
+			add(r(0x33, op[0], op[1], rd(), rs(), rs()));
+		} break;
+		case 3: case 4: { //ALU immediate
+			uint32_t f3 = rand32() % 8;
+			uint32_t imm = rand32();
+			if(f3 == 1) imm &= 0x1F;
+			if(f3 == 5) imm &= 0x41F;
+			add(i(0x13, f3, rd(), rs(), imm));
+		} break;
+		case 5: add(u(rand32() & 1 ? 0x37 : 0x17, rd(), rand32())); break;
+		case 6: { //Load
+			static const uint32_t f3s[] = {0, 1, 2, 4, 5};
+			uint32_t f3 = f3s[rand32() % 5];
+			add(i(0x03, f3, rd(), rDataBase, dataOffset(1 << (f3 & 3))));
+		} break;
+		case 7: { //Store
+			uint32_t f3 = rand32() % 3;
+			add(s(0x23, f3, rDataBase, rs(), dataOffset(1 << f3)));
+		} break;
+		case 8: { //Forward branch
+			static const uint32_t f3s[] = {0, 1, 4, 5, 6, 7};
+			addFixup(r(0x63, f3s[rand32() % 6], 0, 0, rs(), rs()), 0, 4, BRANCH, forward);
+		} break;
+		case 9:
+			if(rand32() & 1){
+				addFixup(0x6F | ((rand32() & 1 ? rd() : 0) << 7), 0, 4, JAL, forward);
+			} else {
+				uint32_t reg = rd();
+				addFixup(u(0x17, reg, 0), i(0x67, 0, rand32() & 1 ? rd() : 0, reg, 0), 8, AUIPC_PAIR, forward); //auipc + jalr
+			}
+			break;
+		case 10: //Multiplication/division
+			#ifdef MUL
+			if(rand32() & 1) { add(r(0x33, rand32() % 4, 1, rd(), rs(), rs())); break; }
+			#endif
+			#ifdef DIV
+			add(r(0x33, 4 + rand32() % 4, 1, rd(), rs(), rs()));
+			#endif
+			break;
+		case 11: //CSR traffic and traps
+			#ifdef CSR
+			switch(rand32() % 4){
+			case 0: add(0x00000073); break; //ecall
+			case 1: add(i(0x73, 1 + rand32() % 3, rd(), rs(), supervisor ? 0x140 : 0x340)); break;
+			case 2: add(i(0x73, 5 + rand32() % 3, rd(), rand32() % 32, supervisor ? 0x140 : 0x340)); break;
+			case 3: add(i(0x73, 2, rd(), 0, supervisor ? 0x140 : 0x341 + rand32() % 2)); break;
+			}
+			#endif
+			break;
+		case 12: //Atomics, rDataBase + offset is moved into x29
+			#ifdef AMO
+			if(rand32() & 1){
+				static const uint32_t f5s[] = {0x00, 0x01, 0x04, 0x08, 0x0C, 0x10, 0x14, 0x18, 0x1C};
+				addPair(i(0x13, 0, 29, rDataBase, dataOffset(4)), r(0x2F, 2, f5s[rand32() % 9] << 2, rd(), 29, rs()));
+				break;
+			}
+			#endif
+			#ifdef LRSC
+			if(rand32() & 1){
+				addPair(i(0x13, 0, 29, rDataBase, dataOffset(4)), r(0x2F, 2, 0x02 << 2, rd(), 29, 0));
+			} else {
+				addPair(i(0x13, 0, 29, rDataBase, dataOffset(4)), r(0x2F, 2, 0x03 << 2, rd(), 29, rs()));
+			}
+			#endif
+			break;
+		case 13: case 14: case 15: //Compressed
+			#ifdef COMPRESSED
+			switch(rand32() % 8){
+			case 0: { uint32_t imm = 1 + rand32() % 31; addC((0 << 13) | (rd() << 7) | (imm << 2) | (rand32() & 1) << 12 | 1); } break; //c.addi
+			case 1: addC((2 << 13) | (rd() << 7) | ((rand32() & 0x1F) << 2) | (rand32() & 1) << 12 | 1); break; //c.li
+			case 2: { uint32_t reg; do { reg = rd(); } while(reg == 2); addC((3 << 13) | (1 << 12) | (reg << 7) | ((rand32() & 0x1F) << 2) | 1); } break; //c.lui
+			case 3: addC((4 << 13) | ((rand32() % 3) << 10) | ((rc() - 8) << 7) | ((1 + rand32() % 31) << 2) | 1); break; //c.srli c.srai c.andi
+			case 4: addC((4 << 13) | (3 << 10) | ((rc() - 8) << 7) | ((rand32() % 4) << 5) | ((rc() - 8) << 2) | 1); break; //c.sub c.xor c.or c.and
+			case 5: addC((0 << 13) | (rd() << 7) | ((1 + rand32() % 31) << 2) | 2); break; //c.slli
+			case 6: addC((8 << 12) | (rd() << 7) | ((1 + rand32() % 31) << 2) | 2); break; //c.mv
+			case 7: addC((9 << 12) | (rd() << 7) | ((1 + rand32() % 31) << 2) | 2); break; //c.add
+			}
+			#endif
+			break;
+		}
+	}
+
+	//Replace the body items [start, start+count[ by NOPs, return false if there was nothing to replace
+	bool nop(uint32_t start, uint32_t count){
+		bool changed = false;
+		for(uint32_t idx = bodyStart + start;idx < min(bodyStart + start + count, bodyEnd);idx++){
+			Item &item = items[idx];
+			uint32_t word0 = item.size == 2 ? 0x0001 : 0x00000013;
+			if(item.word[0] == word0 && (item.size != 8 || item.word[1] == 0x00000013)) continue;
+			item.word[0] = word0;
+			item.word[1] = 0x00000013;
+			item.fixup = NONE;
+			changed = true;
+		}
+		return changed;
+	}
+
+	uint32_t bodySize() { return bodyEnd - bodyStart; }
+	uint32_t timeout() { return 10000 + bodySize() * 100; }
+
+	vector<Segment> image(){
+		vector<uint32_t> addresses;
+		uint32_t address = codeBase;
+		for(Item &item : items){
+			addresses.push_back(address);
+			address += item.size;
+		}
+		Segment code;
+		code.address = codeBase;
+		for(uint32_t idx = 0;idx < items.size();idx++){
+			Item item = items[idx];
+			uint32_t offset = item.fixup != NONE ? addresses[item.target] - addresses[idx] : 0;
+			switch(item.fixup){
+			case NONE: break;
+			case BRANCH: item.word[0] |= bImm(offset); break;
+			case JAL: item.word[0] |= jImm(offset); break;
+			case AUIPC_PAIR: item.word[1] |= (offset & 0xFFF) << 20; break;
+			}
+			for(uint32_t b = 0;b < item.size;b++) code.data.push_back(item.word[b/4] >> ((b%4)*8));
+		}
+		vector<Segment> ret = segments;
+		ret.push_back(code);
+		return ret;
+	}
+
+	//Intel hex dump of the program, which can be replayed with RUN_HEX
+	void writeHex(string path){
+		FILE *file = fopen(path.c_str(), "w");
+		for(Segment &segment : image()){
+			uint32_t upper = -1;
+			for(uint32_t idx = 0;idx < segment.data.size();idx += 16){
+				uint32_t address = segment.address + idx;
+				if(address >> 16 != upper){
+					upper = address >> 16;
+					fprintf(file, ":02000004%04X%02X\n", upper, (-(6 + (upper >> 8) + (upper & 0xFF))) & 0xFF);
+				}
+				uint32_t count = min<uint32_t>(16, segment.data.size() - idx);
+				uint32_t checksum = count + ((address >> 8) & 0xFF) + (address & 0xFF);
+				fprintf(file, ":%02X%04X00", count, address & 0xFFFF);
+				for(uint32_t b = 0;b < count;b++){
+					fprintf(file, "%02X", segment.data[idx + b]);
+					checksum += segment.data[idx + b];
+				}
+				fprintf(file, "%02X\n", (-checksum) & 0xFF);
+			}
+		}
+		fprintf(file, ":00000001FF\n");
+		fclose(file);
+	}
+};
+
+class Fuzz : public WorkspaceRegression{
+public:
+	Fuzz(string name, FuzzProgram &program) : WorkspaceRegression(name){
+		withRiscvRef();
+		for(FuzzProgram::Segment &segment : program.image()){
+			for(uint32_t idx = 0;idx < segment.data.size();idx++){
+				*mem.get(segment.address + idx) = segment.data[idx];
+				*riscvRef.mem.get(segment.address + idx) = segment.data[idx];
+			}
+		}
+		bootAt(FuzzProgram::codeBase);
+	}
+};
+
+//Shrink candidates are not tests of the regression, remove them from the counters
+static bool fuzzShrinkFails(string name, FuzzProgram &program){
+	bool failed = Fuzz(name, program).run(program.timeout())->failed;
+	Workspace::staticMutex.lock();
+	Workspace::testsCounter--;
+	if(!failed) Workspace::successCounter--;
+	Workspace::staticMutex.unlock();
+	return failed;
+}
+
+static void fuzz(uint32_t seed){
+	FuzzProgram program(seed, FUZZ_LENGTH);
+	string name = "fuzz_" + to_string(seed);
+	if(!Fuzz(name, program).run(program.timeout())->failed) return;
+
+	//Shrink the failing program by replacing chunks of its body with NOPs as long as it keeps failing
+	uint32_t attempts = 0;
+	for(uint32_t chunk = program.bodySize()/2;chunk != 0 && attempts < 200;chunk /= 2){
+		for(uint32_t start = 0;start < program.bodySize() && attempts < 200;start += chunk){
+			FuzzProgram candidate = program;
+			if(!candidate.nop(start, chunk)) continue;
+			attempts++;
+			if(fuzzShrinkFails(name + "_shrink", candidate)) program = candidate;
+		}
+	}
+
+	uint32_t remaining = 0;
+	for(uint32_t idx = program.bodyStart;idx < program.bodyEnd;idx++){
+		FuzzProgram::Item &item = program.items[idx];
+		if(item.word[0] != (item.size == 2 ? 0x0001u : 0x00000013u) || (item.size == 8 && item.word[1] != 0x00000013)) remaining++;
+	}
+	program.writeHex(name + "_shrink.hex");
+	Workspace::staticMutex.lock();
+	cout << "FUZZ " << name << " shrunk to " << remaining << " instructions in " << name << "_shrink.hex" << endl;
+	Workspace::staticMutex.unlock();
+}
+#endif
+
 int main(int argc, char **argv, char **env) {
     #ifdef SEED
     srand48(SEED);
@@ -3853,6 +5570,7 @@ int main(int argc, char **argv, char **env) {
 			#ifdef DEBUG_PLUGIN
 			#ifndef CONCURRENT_OS_EXECUTIONS
 				redo(REDO,DebugPluginTest().run(1e6););
+				redo(REDO,DebugPluginBench().run(4e6););
             #endif
 			#endif
 		#endif
@@ -3870,6 +5588,10 @@ int main(int argc, char **argv, char **env) {
 			redo(REDO,WorkspaceRegression("lrsc").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../raw/lrsc/build/lrsc.hex")->bootAt(0x00000000u)->run(10e3););
 		#endif
 
+		#ifdef UTIME_INPUT
+			redo(REDO,WorkspaceRegression("utime").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../raw/utime/build/utime.hex")->bootAt(0x80000000u)->run(10e3););
+		#endif
+
 		#ifdef PMP
 			redo(REDO,WorkspaceRegression("pmp").loadHex(string(REGRESSION_PATH) + "../raw/pmp/build/pmp.hex")->bootAt(0x80000000u)->run(10e3););
 		#endif
@@ -3878,6 +5600,16 @@ int main(int argc, char **argv, char **env) {
 			redo(REDO,WorkspaceRegression("amo").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../raw/amo/build/amo.hex")->bootAt(0x00000000u)->run(10e3););
 		#endif
 
+		#ifdef FUZZ
+		{
+			queue <std::function<void()>> tasks;
+			for(uint32_t idx = 0;idx < FUZZ;idx++){
+				tasks.push([=]() { fuzz(FUZZ_SEED + idx); });
+			}
+			multiThreadedExecute(tasks);
+		}
+		#endif
+
 		#ifdef DHRYSTONE
 			Dhrystone("dhrystoneO3_Stall","dhrystoneO3",true,true).run(1.5e6);
 			#if defined(COMPRESSED)
@@ -3936,6 +5668,9 @@ int main(int argc, char **argv, char **env) {
                 for(const string &name : freeRtosTests){
                     tasks.push_back([=]() { WorkspaceRegression(name + "_rv32i_O0").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../../resources/freertos/" + name + "_rv32i_O0.hex")->bootAt(0x80000000u)->run(4e6*15);});
                     tasks.push_back([=]() { WorkspaceRegression(name + "_rv32i_O3").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../../resources/freertos/" + name + "_rv32i_O3.hex")->bootAt(0x80000000u)->run(4e6*15);});
+                    #ifdef BENCH
+                    tasks.push_back([=]() { WorkspaceRegression(name + "_rv32i_O3_nostall").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../../resources/freertos/" + name + "_rv32i_O3.hex")->bootAt(0x80000000u)->setIStall(false)->setDStall(false)->run(4e6*15);});
+                    #endif
                     #ifdef COMPRESSED
 //                        tasks.push_back([=]() { WorkspaceRegression(name + "_rv32ic_O0").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../../resources/freertos/" + name + "_rv32ic_O0.hex")->bootAt(0x80000000u)->run(5e6*15);});
                         tasks.push_back([=]() { WorkspaceRegression(name + "_rv32ic_O3").withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../../resources/freertos/" + name + "_rv32ic_O3.hex")->bootAt(0x80000000u)->run(4e6*15);});
@@ -3992,6 +5727,9 @@ int main(int argc, char **argv, char **env) {
         #endif
 
 		#if defined(LINUX_REGRESSION)
+            #ifndef DEBUG_PLUGIN_EXTERNAL
+            redo(REDO,HostFileRegression().withRiscvRef()->loadHex(string(REGRESSION_PATH) + "../raw/hostFile/build/hostFile.hex")->bootAt(0x80000000u)->run(50e3););
+            #endif
             {
 
         	    LinuxRegression soc("linux");
@@ -4022,6 +5760,9 @@ int main(int argc, char **argv, char **env) {
 		cout<< "REGRESSION FAILURE " << Workspace::testsCounter - Workspace::successCounter << "/"  << Workspace::testsCounter << endl;
 	cout << "****************************************************************" << endl << endl;
 
+	#ifdef BENCH
+	Bench::dump(BENCH_JSON);
+	#endif
 
 	exit(0);
 }
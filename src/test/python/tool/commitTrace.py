@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+# Turn the binary commit trace of the Briey simulation (TRACE_COMMIT=yes) back into text, one line per record :
+# cycle pc instruction [xRD = value]
+# usage : commitTrace.py [commitTrace.gz]
+
+import gzip
+from sys import argv, stdout
+
+COMMIT = 0x01
+PC_SEQ = 0x02
+INSTR_CACHED = 0x04
+REG = 0x08
+CACHE = 1024
+
+def records(data):
+	if data[0:5] != b"VXCT\x01":
+		raise Exception("Not a commit trace")
+	ptr = 5
+
+	def varint():
+		nonlocal ptr
+		value = shift = 0
+		while True:
+			byte = data[ptr]
+			ptr += 1
+			value |= (byte & 0x7F) << shift
+			shift += 7
+			if byte < 0x80:
+				return value
+
+	def zigzag():
+		value = varint()
+		return (value >> 1) ^ -(value & 1)
+
+	cycle = pc = 0
+	regs = [0] * 32
+	instructions = [0] * CACHE
+	while ptr < len(data):
+		start = ptr
+		try:
+			flags = data[ptr]
+			ptr += 1
+			cycle += varint()
+			pc = (pc + 4 if flags & PC_SEQ else pc + zigzag()) & 0xFFFFFFFF
+			instruction = None
+			if flags & COMMIT:
+				if flags & INSTR_CACHED:
+					instruction = instructions[(pc >> 2) % CACHE]
+				else:
+					instruction = int.from_bytes(data[ptr:ptr + 4], "little")
+					if ptr + 4 > len(data):
+						raise IndexError()
+					ptr += 4
+					instructions[(pc >> 2) % CACHE] = instruction
+			rd = None
+			if flags & REG:
+				rd = data[ptr]
+				ptr += 1
+				regs[rd] = (regs[rd] + zigzag()) & 0xFFFFFFFF
+		except IndexError:
+			# Trace of a killed simulation, the last record is incomplete
+			ptr = start
+			break
+		yield cycle, pc, instruction, rd, regs[rd] if rd is not None else None
+
+def read(path):
+	with gzip.open(path, "rb") as f:
+		data = bytearray()
+		try:
+			while True:
+				block = f.read(1 << 20)
+				if not block:
+					break
+				data += block
+		except EOFError:
+			# The compressor was not closed
+			pass
+	return bytes(data)
+
+if __name__ == "__main__":
+	path = argv[1] if len(argv) > 1 else "commitTrace.gz"
+	out = stdout
+	for cycle, pc, instruction, rd, value in records(read(path)):
+		line = "%d %08x " % (cycle, pc)
+		line += "%08x" % instruction if instruction is not None else "--------"
+		if rd is not None:
+			line += " x%d = %08x" % (rd, value)
+		out.write(line + "\n")
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+# Scripted GDB remote serial protocol session against the GDB_SERVER stub of the regression testbench
+# (src/test/cpp/regression/main.cpp). It halts the CPU, loads a small loop in the memory, reads the registers and the
+# memory back, and checks that software breakpoints and single steps stop at the expected pc. Malformed packets have
+# to be rejected with E01.
+# usage : gdbRsp.py [port] [ram address in hex]
+
+import socket
+from sys import argv, exit
+
+PC = 32
+PROGRAM = [
+	0x00000293, # addi x5, x0, 0
+	0x00128293, # loop: addi x5, x5, 1
+	0xffdff06f, # j loop
+]
+
+class Rsp:
+	def __init__(self, port):
+		self.sock = socket.create_connection(("127.0.0.1", port))
+		self.sock.settimeout(30)
+
+	def read(self):
+		data = self.sock.recv(1)
+		if not data:
+			raise Exception("Connection closed")
+		return chr(data[0])
+
+	def send(self, data, checksum=None):
+		if checksum is None:
+			checksum = sum(data.encode()) & 0xFF
+		self.sock.sendall(("$%s#%02x" % (data, checksum)).encode())
+		return self.read()
+
+	def receive(self):
+		while self.read() != "$":
+			pass
+		data = ""
+		while True:
+			c = self.read()
+			if c == "#":
+				break
+			data += c
+		checksum = int(self.read() + self.read(), 16)
+		if checksum != sum(data.encode()) & 0xFF:
+			raise Exception("Bad checksum in reply %s" % data)
+		self.sock.sendall(b"+")
+		return data
+
+	def command(self, data):
+		ack = self.send(data)
+		if ack != "+":
+			raise Exception("%s not acknowledged (%s)" % (data, ack))
+		return self.receive()
+
+def hex32(value):
+	return value.to_bytes(4, "little").hex()
+
+def registers(rsp):
+	data = rsp.command("g")
+	return [int.from_bytes(bytes.fromhex(data[i*8:i*8+8]), "little") for i in range(33)]
+
+def check(name, value, expected):
+	print("%s %08x" % (name, value))
+	if value != expected:
+		print("FAIL, %08x expected" % expected)
+		exit(1)
+
+def expect(name, reply, expected):
+	print("%s %s" % (name, reply))
+	if reply != expected:
+		print("FAIL, %s expected" % expected)
+		exit(1)
+
+if __name__ == "__main__":
+	port = int(argv[1]) if len(argv) > 1 else 3333
+	base = int(argv[2], 16) if len(argv) > 2 else 0x80000000
+	rsp = Rsp(port)
+	if rsp.send("g", 0) != "-":
+		print("FAIL, bad checksum acknowledged")
+		exit(1)
+
+	print("halt " + rsp.command("?"))
+	for packet in ["P20", "P20=0", "M%x,10:00" % base, "M%x,4" % base, "m%x,ffffffff" % base, "Z0"]:
+		expect("malformed " + packet, rsp.command(packet), "E01")
+	image = "".join(hex32(i) for i in PROGRAM)
+	expect("load", rsp.command("M%x,%x:%s" % (base, len(PROGRAM)*4, image)), "OK")
+	expect("read", rsp.command("m%x,%x" % (base, len(PROGRAM)*4)), image)
+	rsp.command("P%x=%s" % (PC, hex32(base)))
+	check("pc", registers(rsp)[PC], base)
+
+	rsp.command("Z0,%x,4" % (base + 8))
+	print("continue " + rsp.command("c"))
+	regs = registers(rsp)
+	check("breakpoint pc", regs[PC], base + 8)
+	check("x5", regs[5], 1)
+
+	rsp.command("z0,%x,4" % (base + 8))
+	print("step " + rsp.command("s"))
+	check("step pc", registers(rsp)[PC], base + 4)
+
+	rsp.command("Z0,%x,4" % (base + 8))
+	print("continue " + rsp.command("c"))
+	regs = registers(rsp)
+	check("breakpoint pc", regs[PC], base + 8)
+	check("x5", regs[5], 2)
+	expect("memory", rsp.command("m%x,8" % base), image[:16])
+
+	rsp.command("D")
+	print("PASS")
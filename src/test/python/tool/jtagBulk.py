@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+
+# Client of the simulated JTAG server (src/test/cpp/common/jtag.h) of Murax and Briey. It reads the IDCODE of the
+# debug bridge TAP with the legacy one byte per edge commands, then with a single bulk shift, and checks that both
+# protocols return the same value.
+# usage : jtagBulk.py [port] [expected idcode in hex]
+
+import socket
+from sys import argv, exit
+
+JTAG_BULK = 0x80
+JTAG_BULK_TDO = 0x01
+IR_WIDTH = 4
+IR_IDCODE = 1
+
+def idcodeScan():
+	# TMS/TDI of each TCK, and the indexes of the bits shifted in Shift-DR
+	steps = [(1, 0)] * 5 + [(0, 0)]                                 # Test-Logic-Reset, Run-Test/Idle
+	steps += [(1, 0), (1, 0), (0, 0), (0, 0)]                       # Select-DR, Select-IR, Capture-IR, Shift-IR
+	steps += [(int(i == IR_WIDTH - 1), (IR_IDCODE >> i) & 1) for i in range(IR_WIDTH)] # Exit1-IR
+	steps += [(1, 0), (1, 0), (0, 0), (0, 0)]                       # Update-IR, Select-DR, Capture-DR, Shift-DR
+	start = len(steps)
+	steps += [(int(i == 31), 0) for i in range(32)]                 # Exit1-DR
+	steps += [(1, 0), (0, 0)]                                       # Update-DR, Run-Test/Idle
+	return steps, range(start, start + 32)
+
+def receive(sock, size):
+	data = b""
+	while len(data) != size:
+		block = sock.recv(size - len(data))
+		if not block:
+			raise Exception("Connection closed")
+		data += block
+	return data
+
+def legacy(sock, steps):
+	commands = bytearray()
+	for tms, tdi in steps:
+		commands += bytes([tms | tdi << 1, tms | tdi << 1 | 4, tms | tdi << 1 | 8])
+	commands.append(0)
+	sock.sendall(commands)
+	return list(receive(sock, len(steps)))
+
+def bulk(sock, steps):
+	count = len(steps)
+	size = (count + 7) // 8
+	tms, tdi = bytearray(size), bytearray(size)
+	for i, (tmsBit, tdiBit) in enumerate(steps):
+		tms[i // 8] |= tmsBit << (i % 8)
+		tdi[i // 8] |= tdiBit << (i % 8)
+	sock.sendall(bytes([JTAG_BULK | JTAG_BULK_TDO]) + count.to_bytes(4, "little") + tms + tdi)
+	tdo = receive(sock, size)
+	return [(tdo[i // 8] >> (i % 8)) & 1 for i in range(count)]
+
+def idcode(tdo, bits):
+	return sum(tdo[index] << i for i, index in enumerate(bits))
+
+if __name__ == "__main__":
+	port = int(argv[1]) if len(argv) > 1 else 7894
+	expected = int(argv[2], 16) if len(argv) > 2 else None
+	sock = socket.create_connection(("127.0.0.1", port))
+	steps, bits = idcodeScan()
+	legacyId = idcode(legacy(sock, steps), bits)
+	bulkId = idcode(bulk(sock, steps), bits)
+	print("IDCODE legacy=%08x bulk=%08x" % (legacyId, bulkId))
+	if legacyId != bulkId or (expected is not None and bulkId != expected):
+		print("FAIL")
+		exit(1)
+	print("PASS")